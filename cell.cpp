@@ -137,6 +137,12 @@ EX int dirdiff(int dd, int t) {
 
 EX int cellcount = 0;
 
+/** \brief the number of cells ever created; unlike cellcount, never decreases */
+EX int cells_created = 0;
+
+/** \brief the memory reserved for cells and heptagons, see tailored_pool */
+EX size_t tailored_slab_bytes = 0;
+
 EX void destroy_cell(cell *c) {
   tailored_delete(c);
   cellcount--;
@@ -149,6 +155,7 @@ EX cell *newCell(int type, heptagon *master) {
   initcell(c);
   hybrid::will_link(c);
   cellcount++;
+  cells_created++;
   return c;
   }
 
@@ -1228,6 +1235,10 @@ EX void clearCellMemory() {
       delete allmaps[i];
   allmaps.clear();
   currentmap = nullptr;
+  #ifndef NO_TAILORED_ALLOC
+  tailored_pools<cell>::release();
+  tailored_pools<heptagon>::release();
+  #endif
   last_cleared = NULL;
   saved_distances.clear();
   dists_computed.clear();
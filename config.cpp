@@ -326,6 +326,8 @@ EX void initConfig() {
   addsaver(vid.linewidth, "linewidth", 1);
   addsaver(precise_width, "precisewidth", .5);
   addsaver(perfect_linewidth, "perfect_linewidth", 1);
+  addsaver(batch_polygons, "batch_polygons", true);
+  addsaver(batch_in_float, "batch_in_float", false);
   addsaver(linepatterns::width, "pattern-linewidth", 1);
   addsaver(fat_edges, "fat-edges");
   addsaver(pconf.scale, "scale", 1);
@@ -405,6 +407,7 @@ EX void initConfig() {
   addsaver(rug::texturesize, "rug-texturesize");
 #if CAP_RUG
   addsaver(rug::model_distance, "rug-model-distance");
+  addsaver(rug::threads, "rug-threads", 1);
 #endif
 
   addsaverenum(pmodel, "used model", mdDisk);
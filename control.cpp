@@ -656,6 +656,25 @@ EX void mainloopiter() {
   GLWRAP;
   DEBB(DF_GRAPH, ("main loop\n"));
 
+  if(!shapes_ready()) {
+    /* the shapes are generated in the background; keep the window alive without touching the game state */
+    #if CAP_GL
+    if(vid.usingGL) {
+      glClearColor(part(backcolor, 2) / 255.0, part(backcolor, 1) / 255.0, part(backcolor, 0) / 255.0, 1);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      SDL_GL_SwapBuffers();
+      }
+    else
+    #endif
+    {
+      SDL_FillRect(s, NULL, backcolor);
+      SDL_UpdateRect(s, 0, 0, vid.xres, vid.yres);
+      }
+    SDL_PumpEvents();
+    SDL_Delay(10);
+    return;
+    }
+
   #if !CAP_SDLGFX && !CAP_GL 
   vid.wallmode = 0;
   vid.monmode = 0;
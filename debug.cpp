@@ -732,6 +732,12 @@ int read_cheat_args() {
   else if(argis("-testdistances")) {
     PHASE(3); shift(); test_distances(argi());
     }
+  else if(argis("-bfs-incremental")) {
+    PHASEFROM(2); shift(); bfs_incremental = argi();
+    }
+  else if(argis("-bfs-check")) {
+    PHASEFROM(2); shift(); bfs_check = argi();
+    }
   else if(argis("-M")) {
     PHASE(3) cheat(); start_game(); if(WDIM == 3) { drawthemap(); bfs(); }
     shift(); eMonster m = readMonster(args());
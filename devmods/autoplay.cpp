@@ -2,12 +2,21 @@
 // Well, not really -- it performs illegal moves, and it gets tons of treasure, orbs, and kills out of nowhere.
 // Useful for debugging.
 
+// -autoplay-bench N SEED FILE runs N turns in each geometry of bench_matrix, and writes the timings to FILE as JSON, e.g.:
+//   hyper -nogui -autoplay-bench 10000 1 autoplay-bench.json
+
 #include "../hyper.h"
 
 namespace hr {
 
 bool doAutoplay;
 
+/** \brief print the progress, and draw the screen from time to time */
+bool autoplay_verbose = true;
+
+/** \brief the largest cellcount seen during autoplay */
+int autoplay_peak_cells;
+
 namespace prairie { extern long long enter; }
 
 bool sameland(eLand ll, eLand ln) {
@@ -59,7 +68,12 @@ void autoplay(int num_moves = 1000000000) {
       }
     else gcount++;
     
+    autoplay_peak_cells = max(autoplay_peak_cells, cellcount);
+  
     if(false && sameland(lland, cwt.at->land)) lcount++;
+    else if(!autoplay_verbose) {
+      lcount = 0; lland2 = lland; lland = cwt.at->land;
+      }
     else {
       lcount = 0; lland2 = lland; lland = cwt.at->land;
       printf("%10dcc %5dt %5de %5d$ %5dK %5dgc %-30s H%d\n", cellcount, turncount, celldist(cwt.at), gold(), tkills(), gcount, dnameof(cwt.at->land).c_str(), hrand(1000000));
@@ -96,10 +110,11 @@ void autoplay(int num_moves = 1000000000) {
       }
     cwt.spin = 0;
     int d = neighborId(cwt.at, c2);
-    if(d >= 0 && movepcto(d, 1, false))
-      println(hlog, "OK");
+    if(d >= 0 && movepcto(d, 1, false)) {
+      if(autoplay_verbose) println(hlog, "OK");
+      }
     else {    
-      println(hlog, "NOK");
+      if(autoplay_verbose) println(hlog, "NOK");
       killMonster(c2, moNone);
       jumpTo(roKeyboard, c2, itNone, 0, moNone);
       }
@@ -120,7 +135,7 @@ void autoplay(int num_moves = 1000000000) {
       }
 
     if(hrand(5000) == 0 || (isGravityLand(cwt.at->land) && coastvalEdge(cwt.at) >= 100) || gcount > 2000 || cellcount >= 20000000) {
-      printf("RESET\n");
+      if(autoplay_verbose) printf("RESET\n");
       gcount = 0;
       cellcount = 0;
       activateSafety(laCrossroads);
@@ -128,7 +143,7 @@ void autoplay(int num_moves = 1000000000) {
       }
 
     if(cwt.at->land == laWestWall && cwt.at->landparam >= 30) {
-      printf("Safety generated\n");
+      if(autoplay_verbose) printf("Safety generated\n");
       forCellEx(c2, cwt.at) c2->item = itOrbSafety;
       }
     
@@ -158,6 +173,67 @@ void autoplay(int num_moves = 1000000000) {
     }
   }
 
+/** \brief the geometries and variations used by autoplay_benchmark */
+vector<pair<eGeometry, eVariation>> bench_matrix = {
+  {gNormal, eVariation::bitruncated},
+  {gNormal, eVariation::pure},
+  {gOctagon, eVariation::bitruncated},
+  {g45, eVariation::pure},
+  {gEuclid, eVariation::bitruncated},
+  {gEuclidSquare, eVariation::pure},
+  };
+
+string variation_name(eVariation v) {
+  switch(v) {
+    case eVariation::bitruncated: return "bitruncated";
+    case eVariation::pure: return "pure";
+    case eVariation::goldberg: return "goldberg";
+    case eVariation::irregular: return "irregular";
+    case eVariation::dual: return "dual";
+    case eVariation::untruncated: return "untruncated";
+    case eVariation::warped: return "warped";
+    case eVariation::unrectified: return "unrectified";
+    }
+  return "unknown";
+  }
+
+/** \brief run num_moves autoplay turns with the given seed in every configuration of bench_matrix, and write the timings to fname as JSON */
+void autoplay_benchmark(int num_moves, int seed, const string& fname) {
+  fhstream f(fname, "wt");
+  if(!f.f) { println(hlog, "cannot write ", fname); return; }
+  println(f, "[");
+  bool first = true;
+  for(auto& gv: bench_matrix) {
+    stop_game();
+    set_geometry(gv.first);
+    set_variation(gv.second);
+    shrand(seed);
+    start_game();
+    
+    for(int p=0; p<tpCount; p++) turn_phase_time[p] = 0;
+    autoplay_peak_cells = cellcount;
+    autoplay_verbose = false;
+    turn_timers_on = true;
+    auto start = std::chrono::steady_clock::now();
+    autoplay(num_moves);
+    auto stop = std::chrono::steady_clock::now();
+    turn_timers_on = false;
+    autoplay_verbose = true;
+
+    double total = std::chrono::duration<double>(stop - start).count();
+    if(!first) println(f, ",");
+    first = false;
+    print(f, "  {\"geometry\": \"", ginf[gv.first].shortname, "\", \"variation\": \"", variation_name(gv.second), "\"");
+    print(f, ", \"seed\": ", seed, ", \"turns\": ", turncount, ", \"seconds\": ", fts(total, 10));
+    print(f, ", \"turns_per_second\": ", fts(turncount / total, 10));
+    print(f, ", \"bfs\": ", fts(turn_phase_time[tpBFS], 10), ", \"monstersTurn\": ", fts(turn_phase_time[tpMonsters], 10));
+    print(f, ", \"setdist\": ", fts(turn_phase_time[tpSetdist], 10), ", \"save_memory\": ", fts(turn_phase_time[tpSaveMemory], 10));
+    print(f, ", \"peak_cellcount\": ", autoplay_peak_cells, "}");
+    println(hlog, ginf[gv.first].shortname, " ", variation_name(gv.second), ": ", fts(turncount / total), " turns/s");
+    }
+  println(f, "\n]");
+  }
+
 int readArgs() {
   using namespace arg;
            
@@ -171,6 +247,12 @@ int readArgs() {
     shift();
     autoplay(argi());
     }
+  else if(argis("-autoplay-bench")) {
+    PHASE(3); 
+    shift(); int n = argi();
+    shift(); int seed = argi();
+    shift(); autoplay_benchmark(n, seed, args());
+    }
 
   else return 1;
   return 0;
@@ -0,0 +1,320 @@
+// microbenchmarks of the basic routines
+// compile with: mymake -O3 devmods/benchmarks
+
+#include "../hyper.h"
+#include <chrono>
+
+namespace hr {
+
+namespace benchmarks {
+
+/** \brief run f n times, and return the time taken in nanoseconds per call */
+template<class T> double time_ns(int n, const T& f) {
+  auto start = std::chrono::steady_clock::now();
+  for(int i=0; i<n; i++) f(i);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / n;
+  }
+
+/** \brief the plain loops, as used when CAP_SIMD is off */
+hyperpoint scalar_mul(const transmatrix& T, const hyperpoint& H) {
+  hyperpoint z;
+  for(int i=0; i<MXDIM; i++) {
+    z[i] = 0;
+    for(int j=0; j<MXDIM; j++) z[i] += T[i][j] * H[j];
+    }
+  return z;
+  }
+
+transmatrix scalar_mul(const transmatrix& T, const transmatrix& U) {
+  transmatrix R;
+  for(int i=0; i<MXDIM; i++) for(int j=0; j<MXDIM; j++) {
+    R[i][j] = 0;
+    for(int k=0; k<MXDIM; k++)
+      R[i][j] += T[i][k] * U[k][j];
+    }
+  return R;
+  }
+
+/** \brief compare the transmatrix products with scalar_mul, in the current geometry */
+void bench_matrix(int n) {
+  vector<transmatrix> mats;
+  vector<hyperpoint> pts;
+  for(int i=0; i<256; i++) {
+    transmatrix T = spin(randd() * 2 * M_PI) * xpush(randd()) * spin(randd() * 2 * M_PI);
+    if(MDIM == 4) T = T * cspin(0, 2, randd()) * cspin(1, 2, randd());
+    mats.push_back(T);
+    pts.push_back(T * C0);
+    }
+
+  ld maxerr = 0;
+  for(int i=0; i<256; i++) {
+    auto& T = mats[i]; auto& U = mats[(i * 7 + 1) & 255];
+    transmatrix R1 = T * U, R2 = scalar_mul(T, U);
+    hyperpoint h1 = T * pts[i], h2 = scalar_mul(T, pts[i]);
+    for(int a=0; a<MDIM; a++) {
+      maxerr = max(maxerr, abs(h1[a] - h2[a]));
+      for(int b=0; b<MDIM; b++) maxerr = max(maxerr, abs(R1[a][b] - R2[a][b]));
+      }
+    }
+
+  transmatrix acc = Id;
+  hyperpoint hacc = C0;
+  double mm_simd = time_ns(n, [&] (int i) { acc = mats[i & 255] * acc; if(!(i & 63)) acc = Id; });
+  double mm_scalar = time_ns(n, [&] (int i) { acc = scalar_mul(mats[i & 255], acc); if(!(i & 63)) acc = Id; });
+  double mv_simd = time_ns(n, [&] (int i) { hacc = mats[i & 255] * hacc; if(!(i & 63)) hacc = C0; });
+  double mv_scalar = time_ns(n, [&] (int i) { hacc = scalar_mul(mats[i & 255], hacc); if(!(i & 63)) hacc = C0; });
+
+  println(hlog, "geometry: ", full_geometry_name(), " MDIM = ", MDIM, " CAP_SIMD = ", CAP_SIMD, " max difference = ", maxerr);
+  println(hlog, "matrix * matrix: ", fts(mm_simd), " ns (scalar: ", fts(mm_scalar), " ns, speedup ", fts(mm_scalar / mm_simd), ")");
+  println(hlog, "matrix * point:  ", fts(mv_simd), " ns (scalar: ", fts(mv_scalar), " ns, speedup ", fts(mv_scalar / mv_simd), ")");
+  println(hlog, "checksum: ", acc[0][0] + hacc[0]);
+  }
+
+/** \brief emulate the GPU: multiply in single precision */
+glvertex float_mul(const transmatrix& T, const glvertex& v) {
+  GLfloat m[4][4];
+  for(int i=0; i<4; i++) for(int j=0; j<4; j++)
+    m[i][j] = (i < MXDIM && j < MXDIM) ? T[i][j] : i == j;
+  glvertex res;
+  for(int i=0; i<4; i++) {
+    res[i] = 0;
+    for(int j=0; j<4; j++) res[i] += m[i][j] * v[j];
+    }
+  return res;
+  }
+
+/** \brief the error of the projected vertex, relative to its distance from the center */
+ld projected_error(const glvertex& v, const hyperpoint& exact) {
+  int last = MDIM-1;
+  ld err = 0, size = 0;
+  for(int i=0; i<last; i++) {
+    ld e = exact[i] / exact[last];
+    err = max(err, abs(v[i] / v[last] - e));
+    size = max(size, abs(e));
+    }
+  return err / max<ld>(size, 1e-6);
+  }
+
+/** \brief the anchors chosen by batch_drawqueue for a single run of polys: anchors[i] is the anchor of polys[i] */
+vector<transmatrix> batch_anchors(const vector<dqi_poly>& polys, bool limited) {
+  vector<transmatrix> anchors;
+  transmatrix anchor = polys[0].V.T, ianchor = inverse(anchor);
+  for(auto& p: polys) {
+    if(limited && !batch_float_close(ianchor * p.V.T))
+      anchor = p.V.T, ianchor = inverse(anchor);
+    anchors.push_back(anchor);
+    }
+  return anchors;
+  }
+
+/** \brief batch cell shapes within the given distance, drawn from a viewpoint shifted by dist, with and without batch_in_float
+ *
+ *  Fails (exit code 1) if batch_in_float loses more than 4 times the precision of the unbatched path.
+ */
+void bench_batch_float(int maxdist, ld dist) {
+  cgi.require_shapes();
+  cell *c0 = cwt.at;
+  celllister cl(c0, maxdist, 100000, nullptr);
+  transmatrix View0 = xpush(-dist);
+  vector<dqi_poly> polys;
+  for(cell *c: cl.lst) {
+    dqi_poly p;
+    p.V = shiftless(View0 * calc_relative_matrix(c, c0, C0));
+    p.tab = &cgi.ourshape;
+    p.offset = cgi.shDisk.s;
+    p.cnt = cgi.shDisk.e - cgi.shDisk.s;
+    polys.push_back(p);
+    }
+
+  /* the whole list is treated as a single run, as in the draw queue the runs are usually spatially coherent */
+  auto single = batch_anchors(polys, false);
+  auto limited = batch_anchors(polys, true);
+  int anchor_count = 1;
+  for(int i=1; i<isize(polys); i++) if(!eqmatrix(limited[i], limited[i-1], 0)) anchor_count++;
+
+  auto float_vertices = [&] (const vector<transmatrix>& anchors) {
+    batch_vertices.clear();
+    for(int i=0; i<isize(polys); i++) batch_add_vertices_float(polys[i], inverse(anchors[i]) * polys[i].V.T);
+    return batch_vertices;
+    };
+
+  ld err_plain = 0, err_double = 0, err_single = 0, err_float = 0;
+  batch_vertices.clear();
+  for(auto& p: polys) batch_add_vertices(p, p.V.T);
+  auto bv_double = batch_vertices;
+  auto bv_single = float_vertices(single);
+  auto bv_float = float_vertices(limited);
+  int id = 0;
+  for(int i=0; i<isize(polys); i++) {
+    auto& p = polys[i];
+    for(int t=0; t<p.cnt; t++, id++) {
+      auto& v = (*p.tab)[p.offset+t];
+      hyperpoint exact = p.V.T * glhr::gltopoint(v);
+      err_plain = max(err_plain, projected_error(float_mul(p.V.T, v), exact));
+      err_double = max(err_double, projected_error(bv_double[id], exact));
+      err_single = max(err_single, projected_error(float_mul(single[i], bv_single[id]), exact));
+      err_float = max(err_float, projected_error(float_mul(limited[i], bv_float[id]), exact));
+      }
+    }
+
+  vector<transmatrix> ianchors;
+  for(auto& T: limited) ianchors.push_back(inverse(T));
+  int n = max(1, 1000000 / max(id, 1));
+  double t_double = time_ns(n, [&] (int) { batch_vertices.clear(); for(auto& p: polys) batch_add_vertices(p, p.V.T); }) / id;
+  double t_float = time_ns(n, [&] (int) { batch_vertices.clear(); for(int i=0; i<isize(polys); i++) batch_add_vertices_float(polys[i], ianchors[i] * polys[i].V.T); }) / id;
+  batch_vertices.clear();
+
+  println(hlog, "geometry: ", full_geometry_name(), " cells: ", isize(polys), " vertices: ", id, " distance: ", dist, " anchors: ", anchor_count);
+  println(hlog, "relative error: unbatched ", err_plain, " batched in double ", err_double, " batched in float ", err_float, " (single anchor: ", err_single, ")");
+  println(hlog, "ns per vertex: double ", fts(t_double), " float ", fts(t_float), " (speedup ", fts(t_double / t_float), ")");
+  if(err_float > 4 * max<ld>(err_plain, 1e-7)) {
+    println(hlog, "FAIL: batch_in_float loses precision (limit ", batch_float_limit, ")");
+    exit(1);
+    }
+  }
+
+#if CAP_SOLV
+/** \brief compare sn::get_inverse_exp_batch with the one point at a time inverse_exp, in Solv or NIH geometry */
+void bench_solv_inverse(int n) {
+  if(!sn::in()) { println(hlog, "not in Solv/NIH geometry"); return; }
+  sn::get_tabled().load();
+  vector<hyperpoint> pts(n), res1(n), res2(n);
+  for(auto& h: pts) h = point31(randd() * 6 - 3, randd() * 6 - 3, randd() * 4 - 2);
+
+  double t_scalar = time_ns(1, [&] (int) {
+    for(int i=0; i<n; i++) res1[i] = inverse_exp(shiftless(pts[i]), pNORMAL);
+    }) / n;
+  double t_batch = time_ns(1, [&] (int) {
+    sn::get_inverse_exp_batch(n, &pts[0], &res2[0], pNORMAL);
+    }) / n;
+
+  ld maxerr = 0;
+  for(int i=0; i<n; i++) maxerr = max(maxerr, hypot_d(3, res1[i] - res2[i]) / max<ld>(hypot_d(3, res1[i]), 1));
+
+  /* the table lookup alone, without the conversions to and from the table coordinates */
+  auto& tab = sn::get_tabled();
+  vector<hyperpoint> ixyz(n);
+  for(auto& h: ixyz) h = point3(randd(), randd(), randd());
+  double t_get = time_ns(1, [&] (int) {
+    for(int i=0; i<n; i++) res1[i] = tab.get(ixyz[i][0], ixyz[i][1], ixyz[i][2], false);
+    }) / n;
+  double t_get_batch = time_ns(1, [&] (int) { tab.get_batch(n, &ixyz[0], &res2[0], false); }) / n;
+
+  println(hlog, "geometry: ", full_geometry_name(), " points: ", n, " max relative difference: ", maxerr);
+  println(hlog, "inverse_exp, ns per point: scalar ", fts(t_scalar), " batch ", fts(t_batch), " (speedup ", fts(t_scalar / t_batch), ")");
+  println(hlog, "table lookup, ns per point: scalar ", fts(t_get), " batch ", fts(t_get_batch), " (speedup ", fts(t_get / t_get_batch), ")");
+  }
+#endif
+
+#if CAP_RUG
+/** \brief build the rug and run its physics for the given number of seconds, reporting the progress (see -rugv and -rugthreads) */
+void bench_rug(ld seconds) {
+  auto t0 = std::chrono::steady_clock::now();
+  rug::init_model();
+  auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(); };
+  println(hlog, "rug built in ", fts(elapsed()), " s, points: ", isize(rug::points), " threads: ", rug::threads);
+  ld next_report = 0;
+  while(elapsed() < seconds) {
+    rug::physics();
+    if(elapsed() >= next_report) {
+      println(hlog, "t = ", fts(elapsed()), " valid: ", rug::qvalid, "/", isize(rug::points), " iterations: ", rug::queueiter, " error: ", rug::current_total_error);
+      next_report += seconds / 10;
+      }
+    }
+  }
+
+/** \brief time the construction of the rug at the given vertex limits (findRugpoint is used in Archimedean and arb tilings) */
+void bench_rug_build(const vector<int>& limits) {
+  for(int limit: limits) {
+    rug::vertex_limit = limit;
+    /* the first build also generates the cells of the map */
+    rug::init_model();
+    auto t0 = std::chrono::steady_clock::now();
+    rug::init_model();
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    println(hlog, "vertex limit: ", limit, " points: ", isize(rug::points), " triangles: ", isize(rug::triangles), " built in ", fts(t), " s (", fts(t * 1e9 / max(isize(rug::points), 1)), " ns per point)");
+    }
+  rug::clear_model();
+  }
+#endif
+
+/** \brief compare evaluating a formula with parseld and with a compiled exp_parser */
+void bench_formula(int n, const string& formula) {
+  exp_parser ep;
+  ep.s = formula;
+  ep.compile();
+  ld total = 0;
+  double parsed = time_ns(n, [&] (int i) { ticks = i; total += parseld(formula); });
+  double compiled = time_ns(n, [&] (int i) { ticks = i; total -= real(ep.eval()); });
+  println(hlog, "formula: ", formula, " nodes: ", isize(ep.nodes), " difference: ", total);
+  println(hlog, "parsed: ", fts(parsed), " ns (", fts(1e9 / parsed), " evaluations/s), compiled: ", fts(compiled), " ns (", fts(1e9 / compiled), " evaluations/s)");
+  }
+
+/** \brief time the generation of n cells around the start, and deleting them in stop_game */
+void bench_cells(int n) {
+  using clock = std::chrono::steady_clock;
+  auto secs = [] (clock::time_point a, clock::time_point b) { return fts(std::chrono::duration<double>(b - a).count()); };
+  for(int iter=0; iter<2; iter++) {
+    auto t0 = clock::now();
+    celllister cl(cwt.at, 1000, n, nullptr);
+    auto t1 = clock::now();
+    println(hlog, "cells: ", cellcount, " heptagons: ", heptacount, " slabs: ", int(tailored_slab_bytes >> 20), " MB");
+    stop_game();
+    auto t2 = clock::now();
+    println(hlog, "generated in ", secs(t0, t1), " s, deleted in ", secs(t1, t2), " s, slabs left: ", int(tailored_slab_bytes >> 20), " MB");
+    start_game();
+    }
+  }
+
+int readArgs() {
+  using namespace arg;
+
+  if(0) ;
+  else if(argis("-bench-matrix")) {
+    PHASEFROM(3);
+    start_game();
+    shift(); bench_matrix(argi());
+    }
+  else if(argis("-bench-cells")) {
+    PHASEFROM(3);
+    start_game();
+    shift(); bench_cells(argi());
+    }
+  else if(argis("-bench-formula")) {
+    shift(); int n = argi();
+    shift(); bench_formula(n, args());
+    }
+  else if(argis("-bench-batch-float")) {
+    PHASEFROM(3);
+    start_game();
+    shift(); int maxdist = argi();
+    shift(); bench_batch_float(maxdist, argf());
+    }
+  #if CAP_SOLV
+  else if(argis("-bench-solv-inverse")) {
+    PHASEFROM(3);
+    start_game();
+    shift(); bench_solv_inverse(argi());
+    }
+  #endif
+  #if CAP_RUG
+  else if(argis("-bench-rug")) {
+    PHASEFROM(3);
+    start_game();
+    shift(); bench_rug(argf());
+    }
+  else if(argis("-bench-rug-build")) {
+    PHASEFROM(3);
+    start_game();
+    bench_rug_build({20000, 200000, 2000000});
+    }
+  #endif
+  else return 1;
+  return 0;
+  }
+
+auto hooks = addHook(hooks_args, 100, readArgs);
+
+}
+}
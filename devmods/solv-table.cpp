@@ -149,19 +149,11 @@ void fint(FILE *f, int x) { fwrite(&x, sizeof(x), 1, f); }
 void ffloat(FILE *f, float x) { fwrite(&x, sizeof(x), 1, f); }
 
 void write_table(sn::tabled_inverses& tab, const char *fname) {
-  FILE *f = fopen(fname, "wb");
-  fint(f, tab.PRECX);
-  fint(f, tab.PRECY);
-  fint(f, tab.PRECZ);
-  fwrite(&tab.tab[0], sizeof(ptlow) * tab.PRECX * tab.PRECY * tab.PRECZ, 1, f);
-  fclose(f);
+  tab.write(fname);
   }
 
 void alloc_table(sn::tabled_inverses& tab, int X, int Y, int Z) {
-  tab.PRECX = X;
-  tab.PRECY = Y;
-  tab.PRECZ = Z;
-  tab.tab.resize(X*Y*Z);
+  tab.allocate(X, Y, Z);
   }
 
 ld ptd(ptlow p) {
@@ -533,6 +525,7 @@ int readArgs() {
     }
   else if(argis("-improve")) {
     sn::get_tabled().load();
+    sn::get_tabled().make_writable();
     improve(sn::get_tabled());
     }
   else if(argis("-write")) {
@@ -541,6 +534,7 @@ int readArgs() {
     }
   else if(argis("-fix-bugs")) {
     sn::get_tabled().load();
+    sn::get_tabled().make_writable();
     fix_bugs(sn::get_tabled());
     }
   else if(argis("-iz-list")) {
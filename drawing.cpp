@@ -143,6 +143,93 @@ struct dqi_action : drawqueueitem {
   void draw() { action(); }
   virtual color_t outline_group() { return 2; }
   };
+
+/** \brief Drawqueueitems whose destructors do nothing. The draw_queue may drop them without calling the destructor. */
+template<class T> struct dqi_plain : std::false_type {};
+template<> struct dqi_plain<dqi_poly> : std::true_type {};
+template<> struct dqi_plain<dqi_line> : std::true_type {};
+template<> struct dqi_plain<dqi_circle> : std::true_type {};
+
+/** \brief the size of a standard memory block in draw_queue */
+static const size_t dq_block_size = 1<<16;
+
+/** \brief The queue of drawqueueitems (see hr::ptds).
+ *
+ *  The items are placed in memory blocks owned by the queue. The blocks are reused between frames, so queuing shapes does not
+ *  allocate, and clear() only calls the destructors of the items which are not dqi_plain.
+ *  Pointers to items owned by another draw_queue may be pushed too; they are not destroyed by clear().
+ */
+struct draw_queue {
+  /** \brief the items, in the drawing order */
+  vector<drawqueueitem*> items;
+
+  vector<vector<char>> blocks;
+  /** \brief the block we are currently allocating from, and the position in it */
+  int block_id;
+  size_t block_pos;
+  /** \brief the items in our blocks which need their destructors called */
+  vector<drawqueueitem*> to_destroy;
+
+  draw_queue() : block_id(0), block_pos(0) {}
+  draw_queue(const draw_queue&) = delete;
+  draw_queue(draw_queue&& q) : draw_queue() { swap(q); }
+  draw_queue& operator = (draw_queue&& q) { clear(); swap(q); return *this; }
+  ~draw_queue() { clear(); }
+
+  void swap(draw_queue& q) {
+    std::swap(items, q.items); std::swap(blocks, q.blocks); std::swap(to_destroy, q.to_destroy);
+    std::swap(block_id, q.block_id); std::swap(block_pos, q.block_pos);
+    }
+
+  /** \brief get memory for an object of the given size, aligned to alignof(max_align_t) */
+  void *allocate(size_t size) {
+    const size_t al = alignof(max_align_t);
+    size = (size + al - 1) & ~(al - 1);
+    while(true) {
+      if(block_id == isize(blocks))
+        blocks.emplace_back(max(size, dq_block_size));
+      else if(block_pos + size > blocks[block_id].size()) {
+        if(block_pos == 0) blocks.emplace(blocks.begin() + block_id, max(size, dq_block_size));
+        else { block_id++; block_pos = 0; }
+        continue;
+        }
+      void *res = &blocks[block_id][block_pos];
+      block_pos += size;
+      return res;
+      }
+    }
+
+  /** \brief construct a new item of type T owned by this queue, but do not add it to items */
+  template<class T, class... U> T& create(U... u) {
+    static_assert(alignof(T) <= alignof(max_align_t), "overaligned drawqueueitem");
+    T* res = new (allocate(sizeof(T))) T (u...);
+    if(!dqi_plain<T>::value) to_destroy.push_back(res);
+    return *res;
+    }
+
+  /** \brief construct a new item of type T at the end of the queue */
+  template<class T, class... U> T& emplace(U... u) {
+    T& res = create<T>(u...);
+    items.push_back(&res);
+    return res;
+    }
+
+  /** \brief remove all the items, and release our items for reuse */
+  void clear() {
+    items.clear();
+    for(auto p: to_destroy) p->~drawqueueitem();
+    to_destroy.clear();
+    block_id = 0; block_pos = 0;
+    }
+
+  void push_back(drawqueueitem *p) { items.push_back(p); }
+  drawqueueitem*& operator [] (int i) { return items[i]; }
+  drawqueueitem*& back() { return items.back(); }
+  size_t size() const { return items.size(); }
+  bool empty() const { return items.empty(); }
+  vector<drawqueueitem*>::iterator begin() { return items.begin(); }
+  vector<drawqueueitem*>::iterator end() { return items.end(); }
+  };
 #endif
 
 /** \brief Return a reference to i-th component of col. 
@@ -165,7 +252,7 @@ bool fatborder;
 
 EX color_t poly_outline;
 
-EX vector<unique_ptr<drawqueueitem>> ptds;
+EX draw_queue ptds;
 
 #if CAP_GL
 EX color_t text_color;
@@ -2116,6 +2203,40 @@ void dqi_line::draw_back() {
   draw();
   }
 
+/** \brief order-preserving map from float to unsigned */
+unsigned float_sortkey(float f) {
+  unsigned u;
+  memcpy(&u, &f, sizeof(u));
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+  }
+
+/** \brief in 2D, these priorities are sorted by depth */
+bool depth_sorted(PPR p) {
+  return among(p, PPR::REDWALLs, PPR::REDWALLs2, PPR::REDWALLs3, PPR::WALL3s,
+    PPR::LAKEWALL, PPR::INLAKEWALL, PPR::BELOWBOTTOM, PPR::ASHALLOW, PPR::BSHALLOW);
+  }
+
+/** \brief the sorting key of p inside its priority class */
+unsigned long long drawqueue_sortkey(drawqueueitem *p) {
+  if(p->prio == PPR::TRANSPARENT_WALL)
+    return ~(unsigned(p->subprio) ^ 0x80000000u);
+  if(GDIM == 2 && depth_sorted(p->prio)) {
+    auto ap = static_cast<dqi_poly*> (p);
+    ap->cache = xintval(ap->V * xpush0(.1));
+    return float_sortkey(ap->cache);
+    }
+  #if MINIMIZE_GL_CALLS
+  if(p->prio != PPR::CIRCLE && p->prio != PPR::OUTCIRCLE)
+    return ((unsigned long long)(p->color) << 32) | p->outline_group();
+  #endif
+  return 0;
+  }
+
+/** \brief sort ptds by priority, and inside the priority classes by drawqueue_sortkey
+ *
+ *  This is a stable LSD radix sort: first the sortkeys are sorted byte by byte (skipping the bytes which
+ *  are the same in all the items), and then we do a counting sort by priority.
+ */
 EX void sort_drawqueue() {
 
   #if MAXMDIM >= 4 && CAP_GL
@@ -2128,37 +2249,229 @@ EX void sort_drawqueue() {
   
   int siz = isize(ptds);
 
-  #if MINIMIZE_GL_CALLS
-  map<color_t, vector<unique_ptr<drawqueueitem>>> subqueue;
-  for(auto& p: ptds) subqueue[(p->prio == PPR::CIRCLE || p->prio == PPR::OUTCIRCLE) ? 0 : p->outline_group()].push_back(move(p));
-  ptds.clear();
-  for(auto& p: subqueue) for(auto& r: p.second) ptds.push_back(move(r));
-  subqueue.clear();
-  for(auto& p: ptds) subqueue[(p->prio == PPR::CIRCLE || p->prio == PPR::OUTCIRCLE) ? 0 : p->color].push_back(move(p));
-  ptds.clear();
-  for(auto& p: subqueue) for(auto& r: p.second) ptds.push_back(move(r));
-  #endif
+  static vector<unsigned long long> keys;
+  static vector<int> perm, perm2;
+  keys.resize(siz);
+  perm.resize(siz); perm2.resize(siz);
+  unsigned long long keydiff = 0;
     
-  for(auto& p: ptds) {
+  for(int i=0; i<siz; i++) {
+    auto p = ptds[i];
     int pd = p->prio - PPR::ZERO;
     if(pd < 0 || pd >= PMAX) {
       printf("Illegal priority %d\n", pd);
       p->prio = PPR(rand() % int(PPR::MAX));
+      pd = p->prio - PPR::ZERO;
       }
     qp[pd]++;
+    keys[i] = drawqueue_sortkey(p);
+    keydiff |= keys[i] ^ keys[0];
+    perm[i] = i;
     }
   
+  for(int shift=0; shift<64; shift+=8) {
+    if(!((keydiff >> shift) & 255)) continue;
+    int cnt[257];
+    for(int a=0; a<257; a++) cnt[a] = 0;
+    for(int i=0; i<siz; i++) cnt[((keys[i] >> shift) & 255) + 1]++;
+    for(int a=0; a<256; a++) cnt[a+1] += cnt[a];
+    for(int i=0; i<siz; i++) perm2[cnt[(keys[perm[i]] >> shift) & 255]++] = perm[i];
+    swap(perm, perm2);
+    }
+
   int total = 0;
   for(int a=0; a<PMAX; a++) {
     int b = qp[a];
     qp0[a] = qp[a] = total; total += b;
     }
 
-  vector<unique_ptr<drawqueueitem>> ptds2;  
+  static vector<drawqueueitem*> ptds2;
   ptds2.resize(siz);
   
-  for(int i = 0; i<siz; i++) ptds2[qp[int(ptds[i]->prio)]++] = move(ptds[i]);
-  swap(ptds, ptds2);
+  for(int i = 0; i<siz; i++) {
+    auto p = ptds[perm[i]];
+    ptds2[qp[int(p->prio)]++] = p;
+    }
+  swap(ptds.items, ptds2);
+  }
+
+/** \brief should consecutive similar polygons be drawn with a single call (see batch_drawqueue) */
+EX bool batch_polygons = true;
+
+/** \brief how many polygons have been merged by batch_drawqueue in the last frame */
+EX int polygons_batched;
+
+/** \brief compute the merged vertices in single precision, relative to a double precision anchor (see batch_drawqueue) */
+EX bool batch_in_float = false;
+
+/** \brief in hyperbolic geometry, batch_in_float starts a new anchor when the matrix relative to the anchor has an entry larger than this */
+EX ld batch_float_limit = 1.5;
+
+/** \brief can the vertices be transformed by rel in single precision, relative to a double precision anchor? */
+EX bool batch_float_close(const transmatrix& rel) {
+  if(!hyperbolic) return true;
+  for(int i=0; i<MXDIM; i++) for(int j=0; j<MXDIM; j++)
+    if(abs(rel[i][j]) > batch_float_limit) return false;
+  return true;
+  }
+
+/** \brief the vertices of the merged polygons, already transformed */
+EX vector<glvertex> batch_vertices;
+
+/** \brief append the vertices of p, transformed by T, to batch_vertices */
+EX void batch_add_vertices(const dqi_poly& p, const transmatrix& T) {
+  auto& v = *p.tab;
+  for(int t=0; t<p.cnt; t++)
+    batch_vertices.push_back(glhr::pointtogl(T * glhr::gltopoint(v[p.offset+t])));
+  }
+
+/** \brief like batch_add_vertices, but the computation is done in single precision
+ *
+ *  Only accurate if T is not too far from the identity; batch_drawqueue ensures this by using
+ *  the matrix relative to the anchor. In MDIM 3 the last vertex coordinate is kept.
+ */
+EX void batch_add_vertices_float(const dqi_poly& p, const transmatrix& T) {
+  GLfloat m[4][4];
+  for(int i=0; i<4; i++) for(int j=0; j<4; j++)
+    m[j][i] = (i < MXDIM && j < MXDIM) ? T[i][j] : i == j;
+  auto& v = *p.tab;
+  #if CAP_SIMD && SHDIM == 4
+  __m128 c0 = _mm_loadu_ps(m[0]), c1 = _mm_loadu_ps(m[1]), c2 = _mm_loadu_ps(m[2]), c3 = _mm_loadu_ps(m[3]);
+  for(int t=0; t<p.cnt; t++) {
+    const glvertex& x = v[p.offset+t];
+    __m128 res = _mm_mul_ps(c0, _mm_set1_ps(x[0]));
+    res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_set1_ps(x[1])));
+    res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_set1_ps(x[2])));
+    res = _mm_add_ps(res, _mm_mul_ps(c3, _mm_set1_ps(x[3])));
+    glvertex h;
+    _mm_storeu_ps(&h[0], res);
+    batch_vertices.push_back(h);
+    }
+  #else
+  for(int t=0; t<p.cnt; t++) {
+    const glvertex& x = v[p.offset+t];
+    glvertex h;
+    for(int i=0; i<SHDIM; i++) {
+      h[i] = 0;
+      for(int j=0; j<SHDIM; j++) h[i] += m[j][i] * x[j];
+      }
+    batch_vertices.push_back(h);
+    }
+  #endif
+  }
+
+/** \brief can p be merged with other polygons? */
+dqi_poly *batchable(drawqueueitem *p, bool band) {
+  if(typeid(*p) != typeid(dqi_poly)) return nullptr;
+  auto pp = static_cast<dqi_poly*> (p);
+  if(!(pp->flags & POLY_TRIANGLES)) return nullptr;
+  if(pp->flags & (POLY_DEBUG | POLY_INVERSE | POLY_FORCE_INVERTED)) return nullptr;
+  if(pp->tinf || pp->outline || !pp->color || pp->cnt <= 0) return nullptr;
+  /* already merged by an earlier call on the same queue (e.g., for the other eye in VR) */
+  if(pp->tab == &batch_vertices) return nullptr;
+  if(band && pp->V.T[2][2] > 1e8) return nullptr;
+  return pp;
+  }
+
+/** \brief do p1 and p2 use the same GL state? */
+bool same_batch(dqi_poly *p1, dqi_poly *p2) {
+  return p1->prio == p2->prio && p1->color == p2->color && p1->V.shift == p2->V.shift && !((p1->flags ^ p2->flags) & POLY_INTENSE);
+  }
+
+/** \brief merge the runs of consecutive polygons in ptds which can be drawn with the same GL state
+ *
+ *  The vertices of the merged polygons are transformed on the CPU into batch_vertices, and each run is
+ *  replaced with a single dqi_poly using the identity matrix. 
+ *
+ *  If batch_in_float is set, the matrix of the first polygon in the run is used as the anchor: the merged polygon
+ *  uses the anchor matrix, and the vertices are transformed by the matrices relative to the anchor (computed in
+ *  double precision) using single precision. The result is then rounded twice, and in hyperbolic geometry the
+ *  error of the relative vertex is amplified by the anchor; with a single anchor for a run of 6 cells, 10 units
+ *  from the origin, the error is about 50 times larger than without batching. Therefore a new merged polygon with
+ *  a new anchor is started whenever the relative matrix fails batch_float_close; with the default batch_float_limit
+ *  the error stays within about 2 times the unbatched one (see -bench-batch-float in devmods/benchmarks.cpp).
+ *
+ *  Calling this again on the same queue (as vr.cpp does for every eye) leaves the merged polygons unchanged.
+ *
+ *  Only done for triangle-based shapes drawn directly
+ *  with shaders (SF_DIRECT); other models need to process every polygon separately. Not done with CAP_VERTEXBUFFER,
+ *  where the merged vertices would have to be uploaded again for every draw call.
+ */
+EX void batch_drawqueue() {
+  polygons_batched = 0;
+  #if CAP_GL && !CAP_VERTEXBUFFER
+  if(!batch_polygons || !vid.usingGL || current_display->stereo_active() || two_sided_model()) return;
+  if(debugflags & DF_VERTEX) return;
+  #if CAP_ODS
+  if(vid.stereo_mode == sODS) return;
+  #endif
+  if(in_s2xe() || models::get_broken_coord(pmodel)) return;
+  if(!hyperbolic && among(pmodel, mdPolygonal, mdPolynomial)) return;
+  if(sphere && pmodel == mdTwoPoint) return;
+  if(sl2 && pmodel == mdGeodesic && hybrid::csteps) return;
+
+  current_display->set_all(0, 0);
+  flagtype sp = get_shader_flags();
+  if(!(sp & SF_DIRECT)) return;
+  if(sphere && (stretch::factor || ray::in_use)) return;
+  bool band = sp & SF_BAND;
+
+  /* merged polygons refer to batch_vertices by offset, so it may grow, but it is cleared only if no such polygon is left */
+  bool merged_live = false;
+  for(auto p: ptds) if(typeid(*p) == typeid(dqi_poly) && static_cast<dqi_poly*>(p)->tab == &batch_vertices) merged_live = true;
+  if(!merged_live) batch_vertices.clear();
+  static vector<drawqueueitem*> batched;
+  batched.clear();
+
+  int siz = isize(ptds);
+  for(int i=0; i<siz;) {
+    auto p = batchable(ptds[i], band);
+    int j = i+1;
+    if(p) while(j < siz) {
+      auto p2 = batchable(ptds[j], band);
+      if(!p2 || !same_batch(p, p2)) break;
+      j++;
+      }
+    if(j == i+1) {
+      batched.push_back(ptds[i++]);
+      continue;
+      }
+    dqi_poly *merged = nullptr;
+    bool in_float = false;
+    transmatrix ianchor = Id;
+    for(int k=i; k<j; k++) {
+      auto& p2 = *static_cast<dqi_poly*> (ptds[k]);
+      transmatrix rel = in_float ? ianchor * p2.V.T : p2.V.T;
+      if(!merged || (in_float && !batch_float_close(rel))) {
+        if(merged) merged->cnt = isize(batch_vertices) - merged->offset;
+        in_float = batch_in_float && abs(det(p2.V.T)) > 1e-9;
+        transmatrix anchor = in_float ? p2.V.T : Id;
+        if(in_float) ianchor = inverse(anchor), rel = Id;
+        merged = &ptds.create<dqi_poly>();
+        *merged = p2;
+        merged->V = shiftless(anchor, p2.V.shift);
+        merged->tab = &batch_vertices;
+        merged->offset = isize(batch_vertices);
+        batched.push_back(merged);
+        }
+      if(in_float)
+        batch_add_vertices_float(p2, rel);
+      else
+        batch_add_vertices(p2, rel);
+      }
+    merged->cnt = isize(batch_vertices) - merged->offset;
+    polygons_batched += j - i;
+    i = j;
+    }
+  swap(ptds.items, batched);
+
+  for(int a=0; a<PMAX; a++) qp[a] = 0;
+  for(auto p: ptds) qp[int(p->prio)]++;
+  int total = 0;
+  for(int a=0; a<PMAX; a++) {
+    qp0[a] = total; total += qp[a]; qp[a] = total;
+    }
+  #endif
   }
 
 EX void reverse_priority(PPR p) {
@@ -2303,6 +2616,7 @@ EX void draw_main() {
 EX void drawqueue() {
 
   DEBBI(DF_GRAPH, ("drawqueue"));
+  profile_zone pz("drawqueue");
   
   #if CAP_WRL
   if(wrl::in) { wrl::render(); return; }
@@ -2325,39 +2639,12 @@ EX void drawqueue() {
     glClear(GL_STENCIL_BUFFER_BIT);
 #endif
   
-  profile_start(3);
+  profile_start("sort+batch");
   
   sort_drawqueue();
+  batch_drawqueue();
 
-  DEBB(DF_GRAPH, ("sort walls"));
-  
-  if(GDIM == 2) 
-  for(PPR p: {PPR::REDWALLs, PPR::REDWALLs2, PPR::REDWALLs3, PPR::WALL3s,
-    PPR::LAKEWALL, PPR::INLAKEWALL, PPR::BELOWBOTTOM, PPR::ASHALLOW, PPR::BSHALLOW}) {
-    int pp = int(p);
-    if(qp0[pp] == qp[pp]) continue;
-    for(int i=qp0[pp]; i<qp[pp]; i++) {
-      auto ap = (dqi_poly&) *ptds[i];
-      ap.cache = xintval(ap.V * xpush0(.1));
-      }
-    sort(&ptds[qp0[pp]], &ptds[qp[pp]], 
-      [] (const unique_ptr<drawqueueitem>& p1, const unique_ptr<drawqueueitem>& p2) {
-        auto ap1 = (dqi_poly&) *p1;
-        auto ap2 = (dqi_poly&) *p2;
-        return ap1.cache < ap2.cache;
-        });
-    }
-
-  for(PPR p: {PPR::TRANSPARENT_WALL}) {
-    int pp = int(p);
-    if(qp0[pp] == qp[pp]) continue;
-    sort(&ptds[qp0[int(p)]], &ptds[qp[int(p)]], 
-      [] (const unique_ptr<drawqueueitem>& p1, const unique_ptr<drawqueueitem>& p2) {
-        return p1->subprio > p2->subprio;
-        });
-    }
-
-  profile_stop(3);
+  profile_stop();
 
 #if CAP_SDL
   if(current_display->stereo_active() && !vid.usingGL) {
@@ -2428,9 +2715,9 @@ EX void drawqueue() {
 
 #if HDR
 template<class T, class... U> T& queuea(PPR prio, U... u) {
-  ptds.push_back(unique_ptr<T>(new T (u...)));
-  ptds.back()->prio = prio;  
-  return (T&) *ptds.back();
+  T& item = ptds.emplace<T>(u...);
+  item.prio = prio;
+  return item;
   }
 #endif
 
@@ -201,15 +201,117 @@ struct pathdata {
 #endif
 // pathdist end
 
+/** \brief reuse the distances computed by the previous bfs() if the players have not moved */
+EX bool bfs_incremental = false;
+
+/** \brief when bfs_incremental reuses the distances, also compute them from scratch and report the differences (in the distances and in the order of dcal) */
+EX bool bfs_check = false;
+
+/** \brief the order of dcal depends on the random start directions, so it is remembered for each of them */
+struct bfs_order {
+  vector<cell*> dcal;
+  /** \brief a copy of reachedfrom, which is also used by computePathdist */
+  vector<int> reachedfrom;
+  /** \brief the number of cells in dcal whose neighbors have been scanned */
+  int scanned;
+  int first7;
+  };
+
+/** \brief the state of the last bfs_distances(), used by bfs_incremental */
+struct bfs_state {
+  vector<cell*> sources;
+  int distlimit;
+  int cells_created;
+  int cellcount;
+  /** \brief the orders computed for these sources, by the start directions (only with bfs_incremental or bfs_check) */
+  map<vector<int>, bfs_order> orders;
+  /** \brief without bfs_incremental, only scanned and first7 are kept, here */
+  bfs_order plain;
+  /** \brief the order used by the current bfs() */
+  bfs_order *current;
+  };
+
+bfs_state last_bfs;
+
+auto clear_last_bfs = addHook(hooks_clearmemory, 40, [] () {
+  last_bfs.sources.clear();
+  last_bfs.orders.clear();
+  last_bfs.current = nullptr;
+  });
+
+/** \brief the distance part of bfs(): compute cpdist, dcal, reachedfrom and first7 from the given sources
+ *
+ *  dirs[i] is the direction the scan of sources[i] starts from.
+ */
+void bfs_distances(const vector<cell*>& sources, const vector<int>& dirs, int distlimit) {
+  int dcs = isize(dcal);
+  for(int i=0; i<dcs; i++) dcal[i]->cpdist = INFD;
+  dcal.clear(); reachedfrom.clear(); 
+
+  for(int i=0; i<isize(sources); i++) {
+    sources[i]->cpdist = 0;
+    dcal.push_back(sources[i]);
+    reachedfrom.push_back(dirs[i]);
+    }
+
+  int qb = 0;
+  first7 = 0;
+  while(true) {
+    if(qb == isize(dcal)) break;
+    int i, fd = reachedfrom[qb] + 3;
+    cell *c = dcal[qb++];
+    
+    int d = c->cpdist;
+    
+    if(WDIM == 2 && d == distlimit) { first7 = qb; qb--; break; }
+
+    for(int j=0; j<c->type; j++) if(i = (fd+j) % c->type, c->move(i)) {
+      cell *c2 = c->move(i);
+      if(signed(c2->cpdist) > d+1) {
+        if(WDIM == 3 && !gmatrix.count(c2)) {
+          if(!first7) first7 = qb;
+          continue;
+          }
+        c2->cpdist = d+1;
+        dcal.push_back(c2);
+        reachedfrom.push_back(c->c.spin(i));
+        }
+      }
+    }
+
+  if(!bfs_incremental && !bfs_check) {
+    last_bfs.sources.clear();
+    last_bfs.orders.clear();
+    last_bfs.plain.scanned = qb;
+    last_bfs.plain.first7 = first7;
+    last_bfs.current = &last_bfs.plain;
+    return;
+    }
+
+  if(sources != last_bfs.sources || distlimit != last_bfs.distlimit || cells_created != last_bfs.cells_created || cellcount != last_bfs.cellcount) {
+    last_bfs.sources = sources;
+    last_bfs.distlimit = distlimit;
+    last_bfs.cells_created = cells_created;
+    last_bfs.cellcount = cellcount;
+    last_bfs.orders.clear();
+    }
+  auto& o = last_bfs.orders[dirs];
+  o.dcal = dcal;
+  o.reachedfrom = reachedfrom;
+  o.scanned = qb;
+  o.first7 = first7;
+  last_bfs.current = &o;
+  }
+
 /** calculate cpdist, 'have' flags, and do general fixings */
 EX void bfs() {
 
+  turn_timer tt(tpBFS);
+
   calcTidalPhase(); 
     
   yendor::onpath();
   
-  int dcs = isize(dcal);
-  for(int i=0; i<dcs; i++) dcal[i]->cpdist = INFD;
   worms.clear(); ivies.clear(); ghosts.clear(); golems.clear(); 
   tempmonsters.clear(); targets.clear(); 
   statuecount = 0;
@@ -228,23 +330,51 @@ EX void bfs() {
   airmap.clear();
   if(!(hadwhat & HF_ROSE)) rosemap.clear();
   
-  dcal.clear(); reachedfrom.clear(); 
-
   recalcTide = false;
   
+  vector<cell*> sources;
+  vector<int> dirs;
   for(int i=0; i<numplayers(); i++) {
     cell *c = playerpos(i);
     if(!c) continue;
-    if(c->cpdist == 0) continue;
-    c->cpdist = 0;
-    checkTide(c);
-    dcal.push_back(c);
-    reachedfrom.push_back(hrand(c->type));
-    if(!invismove) targets.push_back(c);
+    if(find(sources.begin(), sources.end(), c) != sources.end()) continue;
+    sources.push_back(c);
+    dirs.push_back(hrand(c->type));
     }
   
   int distlimit = gamerange();
 
+  /* the distances do not depend on dirs, but the order of dcal does, so the key includes dirs */
+  bool reuse = bfs_incremental && WDIM == 2 && sources == last_bfs.sources && distlimit == last_bfs.distlimit &&
+    cells_created == last_bfs.cells_created && cellcount == last_bfs.cellcount && last_bfs.orders.count(dirs);
+  
+  if(!reuse)
+    bfs_distances(sources, dirs, distlimit);
+  else if(!bfs_check) {
+    auto& o = last_bfs.orders[dirs];
+    dcal = o.dcal;
+    reachedfrom = o.reachedfrom;
+    first7 = o.first7;
+    last_bfs.current = &o;
+    }
+  else {
+    bfs_order reused = last_bfs.orders[dirs];
+    vector<int> reused_dist;
+    for(cell *c: reused.dcal) reused_dist.push_back(c->cpdist);
+    bfs_distances(sources, dirs, distlimit);
+    int errors = abs(isize(dcal) - isize(reused.dcal)) + (first7 != reused.first7) + (last_bfs.current->scanned != reused.scanned);
+    for(int i=0; i<isize(reused.dcal); i++) {
+      if(int(reused.dcal[i]->cpdist) != reused_dist[i]) errors++;
+      if(i < isize(dcal) && (dcal[i] != reused.dcal[i] || reachedfrom[i] != reused.reachedfrom[i])) errors++;
+      }
+    if(errors) println(hlog, "bfs_check: ", errors, " differences");
+    }
+  
+  for(cell *c: sources) {
+    checkTide(c);
+    if(!invismove) targets.push_back(c);
+    }
+
   for(int i=0; i<numplayers(); i++) {
     cell *c = playerpos(i);
     if(!c) continue;
@@ -253,17 +383,12 @@ EX void bfs() {
       worms.push_back(c);
     }
   
-  int qb = 0;
-  first7 = 0;
-  while(true) {
-    if(qb == isize(dcal)) break;
+  /* replay the scans of bfs_distances, and process each cell when it is discovered */
+  int next = isize(sources);
+  for(int qb=0; qb<last_bfs.current->scanned; qb++) {
     int i, fd = reachedfrom[qb] + 3;
-    cell *c = dcal[qb++];
-    
-    int d = c->cpdist;
+    cell *c = dcal[qb];
     
-    if(WDIM == 2 && d == distlimit) { first7 = qb; break; }
-
     for(int j=0; j<c->type; j++) if(i = (fd+j) % c->type, c->move(i)) {
       // printf("i=%d cd=%d\n", i, c->move(i)->cpdist);
       cell *c2 = c->move(i);
@@ -276,12 +401,8 @@ EX void bfs() {
         (c2->wall == waSulphur || c2->wall == waSulphurC))
         c2->wall = waSea;
       
-      if(c2 && signed(c2->cpdist) > d+1) {
-        if(WDIM == 3 && !gmatrix.count(c2)) {
-          if(!first7) first7 = qb;
-          continue;
-          }
-        c2->cpdist = d+1;
+      if(next < isize(dcal) && dcal[next] == c2) {
+        next++;
         
         // remove treasures
         if(!peace::on && c2->item && c2->cpdist == distlimit && itemclass(c2->item) == IC_TREASURE &&
@@ -337,8 +458,6 @@ EX void bfs() {
           }
         
         if(!keepLightning) c2->ligon = 0;
-        dcal.push_back(c2);
-        reachedfrom.push_back(c->c.spin(i));
         
         checkTide(c2);
                 
@@ -736,6 +855,7 @@ EX void findWormIvy(cell *c) {
   }
   
 EX void monstersTurn() {
+  turn_timer tt(tpMonsters);
   checkSwitch();
   mirror::breakAll();
   DEBB(DF_TURN, ("bfs"));
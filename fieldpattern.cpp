@@ -15,6 +15,9 @@ int limitsq = 10;
 int limitp = 10000;
 int limitv = 100000;
 
+/** \brief the number of threads used by discovery, 0 = one per core */
+int discovery_threads = 0;
+
 #if HDR
 #define currfp fieldpattern::getcurrfp()
 
@@ -301,6 +304,8 @@ struct fpattern {
 
   void set_field(int p, int sq);
 
+  void set_power(int pw);
+
   #if MAXMDIM >= 4
   // general 4D
   vector<transmatrix> fullv;
@@ -318,14 +323,24 @@ struct fpattern {
   };
 
 #if CAP_THREAD && MAXMDIM >= 4
+/** \brief a search for 3D field quotients, running on a pool of threads
+ *
+ *  Every prime p, and every p^2 up to limitsq, is a separate task. The tasks are dealt to the
+ *  queues of the threads, and a thread which has finished its queue steals from the others.
+ */
 struct discovery {
+  /** \brief Prime and wsquare of the last candidate started, for display */
   fpattern experiment;
-  std::shared_ptr<std::thread> discoverer;
+  vector<std::thread> discoverers;
+  /** \brief protects hashes_found, queues, and is_suspended */
   std::mutex lock;
   std::condition_variable cv;
   bool is_suspended;
   bool stop_it;
   
+  /** \brief the candidates (prime, power) still to try, for each thread */
+  vector<std::deque<pair<int, int>>> queues;
+  
   map<unsigned, tuple<int, int, matrix, matrix, matrix, int> > hashes_found;
   discovery() : experiment(0) { is_suspended = false; stop_it = false; experiment.dis = this; experiment.Prime = experiment.Field = experiment.wsquare = 0; }
   
@@ -333,7 +348,9 @@ struct discovery {
   void suspend();
   void check_suspend();
   void schedule_destruction();
-  void discovered();
+  void discovered(fpattern& e);
+  bool next_task(int id, pair<int, int>& task);
+  void work(int id);
   ~discovery();
   };
 #endif
@@ -543,7 +560,7 @@ int fpattern::solve3() {
     P = xP; R = xR; X = xX;
     if(!generate_all3()) continue;
     #if CAP_THREAD && MAXMDIM >= 4
-    if(dis) { dis->discovered(); continue; }
+    if(dis) { dis->discovered(*this); continue; }
     #endif
     if(force_hash && compute_hash() != force_hash) continue;
     cmb++;
@@ -567,6 +584,19 @@ void fpattern::set_field(int p, int sq) {
   for(int a=0; a<MWDIM; a++) for(int b=0; b<MWDIM; b++) Id[a][b] = a==b?1:0;
   }
 
+/** \brief set Field to Prime^pw (pw = 1 or 2), and wsquare to a non-square if pw = 2 */
+void fpattern::set_power(int pw) {
+  Field = pw==1? Prime : Prime*Prime;
+  
+  if(pw == 2) {
+    for(wsquare=1; wsquare<Prime; wsquare++) {
+      int roots = 0;
+      for(int a=0; a<Prime; a++) if((a*a)%Prime == wsquare) roots++;
+      if(!roots) break;
+      }
+    } else wsquare = 0;
+  }
+
 int fpattern::solve() {
   
   for(int a=0; a<MWDIM; a++) for(int b=0; b<MWDIM; b++) Id[a][b] = a==b?1:0;
@@ -581,15 +611,7 @@ int fpattern::solve() {
   for(dual=0; dual<3; dual++) {
   for(int pw=1; pw<3; pw++) {
     if(pw>3) break;
-    Field = pw==1? Prime : Prime*Prime;
-    
-    if(pw == 2) {
-      for(wsquare=1; wsquare<Prime; wsquare++) {
-        int roots = 0;
-        for(int a=0; a<Prime; a++) if((a*a)%Prime == wsquare) roots++;
-        if(!roots) break;
-        }
-      } else wsquare = 0;
+    set_power(pw);
 
     #if MAXMDIM >= 4
     if(WDIM == 3) {
@@ -1283,27 +1305,61 @@ EX void field_from_current() {
 EX map<string, discovery> discoveries;
 
 void discovery::activate() {
-  if(!discoverer) {
-    discoverer = std::make_shared<std::thread> ( [this] {
-      for(int p=2; p<100; p++) {
-        experiment.Prime = p;
-        experiment.solve();
-        if(stop_it) break;
-        }
-      });
+  if(discoverers.empty()) {
+    /* the relations are stored in cgi, so compute them before the threads need them */
+    reg3::construct_relations();
+    int threads = discovery_threads ? discovery_threads : max<int>(std::thread::hardware_concurrency(), 1);
+    queues.resize(threads);
+    int k = 0;
+    for(int p=2; p<100; p++) if(isprime(p))
+      for(int pw=1; pw<=(p <= limitsq ? 2 : 1); pw++)
+        queues[(k++) % threads].emplace_back(p, pw);
+    for(int id=0; id<threads; id++)
+      discoverers.emplace_back([this, id] { work(id); });
     }
   if(is_suspended) {
     if(1) {
       std::unique_lock<std::mutex> lk(lock);
       is_suspended = false;
       }
-    cv.notify_one();
+    cv.notify_all();
+    }
+  }
+
+/** \brief take the next task from our queue, or steal the last task of another queue */
+bool discovery::next_task(int id, pair<int, int>& task) {
+  std::unique_lock<std::mutex> lk(lock);
+  int threads = isize(queues);
+  for(int i=0; i<threads; i++) {
+    auto& q = queues[(id+i) % threads];
+    if(q.empty()) continue;
+    if(i == 0) task = q.front(), q.pop_front();
+    else task = q.back(), q.pop_back();
+    experiment.Prime = task.first;
+    experiment.wsquare = task.second == 2;
+    return true;
+    }
+  return false;
+  }
+
+void discovery::work(int id) {
+  pair<int, int> task;
+  while(true) {
+    check_suspend();
+    if(stop_it || !next_task(id, task)) break;
+    fpattern fp(0);
+    fp.dis = this;
+    fp.set_field(task.first, 0);
+    fp.set_power(task.second);
+    fp.rotations = 4;
+    fp.local_group = 24;
+    fp.dual = 0;
+    fp.solve3();
     }
   }
 
-void discovery::discovered() {
+void discovery::discovered(fpattern& e) {
   std::unique_lock<std::mutex> lk(lock);
-  auto& e = experiment;
   hashes_found[e.compute_hash()] = make_tuple(e.Prime, e.wsquare, e.R, e.P, e.X, isize(e.matrices) / e.local_group);
   }
 
@@ -1315,7 +1371,7 @@ void discovery::check_suspend() {
   }
 
 void discovery::schedule_destruction() { stop_it = true; }
-discovery::~discovery() { schedule_destruction(); if(discoverer) discoverer->join(); }
+discovery::~discovery() { schedule_destruction(); for(auto& t: discoverers) t.join(); }
 #endif
 
 int hk = 
@@ -1333,6 +1389,7 @@ int hk =
       else if(argis("-q3-limitsq")) { shift(); limitsq = argi(); }
       else if(argis("-q3-limitp")) { shift(); limitp = argi(); }
       else if(argis("-q3-limitv")) { shift(); limitv = argi(); }
+      else if(argis("-q3-threads")) { shift(); discovery_threads = argi(); }
       else return 1;
       return 0;
       })
@@ -421,7 +421,7 @@ EX void showQuotientConfig3() {
   
   auto& ds = discoveries[cginf.tiling_name];
   
-  if(!ds.discoverer) {
+  if(ds.discoverers.empty()) {
     dialog::addItem("start discovery", 's');
     dialog::add_action([&ds] { ds.activate(); });
     }
@@ -363,8 +363,13 @@ hpcshape
   void prepare_basics();
   void prepare_compute3();
   void prepare_shapes();
+  bool generate_shapes();
   void prepare_usershapes();
 
+  vector<pair<hpcshape*, hpcshape*>> shape_ranges();
+  bool load_shape_cache();
+  void save_shape_cache();
+
   void hpcpush(hyperpoint h);
   void hpcsquare(hyperpoint h1, hyperpoint h2, hyperpoint h3, hyperpoint h4);
   void chasmifyPoly(double fac, double fac2, int k);
@@ -455,7 +460,9 @@ hpcshape
   geometry_information() { last = NULL; }
   
   void require_basics() { if(state & 1) return; state |= 1; prepare_basics(); }
-  void require_shapes() { if(state & 2) return; state |= 2; prepare_shapes(); }
+  /** state & 4: the shapes are being generated by a shape_job */
+  void require_shapes();
+  bool request_shapes();
   void require_usershapes() { if(usershape_state == usershape_changes) return; usershape_state = usershape_changes; prepare_usershapes(); }
   int timestamp;
   
@@ -1081,6 +1088,7 @@ EX string cgi_string() {
 EX void check_cgi() {
   string s = cgi_string();
   
+  if(shape_job_target() && shape_job_target() != &cgis[s]) finish_shape_job();
   cgip = &cgis[s];
   cgi.timestamp = ++ntimestamp;
   if(hybri) hybrid::underlying_cgip->timestamp = ntimestamp;
@@ -1112,6 +1120,7 @@ EX void check_cgi() {
 
 void clear_cgis() {
   printf("clear_cgis\n");
+  finish_shape_job();
   for(auto& p: cgis) if(&p.second != &cgi) { cgis.erase(p.first); return; }
   }
 
@@ -403,7 +403,7 @@ ld hrmap_standard::spin_angle(cell *c, int d) {
     auto id = irr::cellindex[c];
     auto& vs = irr::cells[id];
     if(d < 0 || d >= c->type) return 0;
-    auto& p = vs.jpoints[vs.neid[d]];
+    auto p = irr::jpoint_of(vs, vs.neid[d]);
     return -atan2(p[1], p[0]) - hexshift;
     }
   #endif
@@ -605,7 +605,7 @@ EX hyperpoint nearcorner(cell *c, int i) {
   #if CAP_IRR
   if(IRREGULAR) {
     auto& vs = irr::cells[irr::cellindex[c]];
-    hyperpoint nc = vs.jpoints[vs.neid[i]];
+    hyperpoint nc = irr::jpoint_of(vs, vs.neid[i]);
     return mid_at(C0, nc, .94);
     }
   #endif
@@ -4634,8 +4634,7 @@ EX void drawthemap() {
   if(sightrange_bonus > 0 && !allowIncreasedSight()) 
     sightrange_bonus = 0;
   
-  profile_frame();
-  profile_start(0);
+  profile_start("drawthemap");
   swap(gmatrix0, gmatrix);
   gmatrix.clear();
   current_display->all_drawn_copies.clear();
@@ -4709,7 +4708,7 @@ EX void drawthemap() {
   
   arrowtraps.clear();
 
-  profile_start(1);
+  profile_start("draw_all");
   make_actual_view();
   currentmap->draw_all();
   drawWormSegments();
@@ -4724,10 +4723,10 @@ EX void drawthemap() {
   
   callhooks(hooks_frame);
   
-  profile_stop(1);
-  profile_start(4);
+  profile_stop();
+  profile_start("drawMarkers");
   drawMarkers();
-  profile_stop(4);
+  profile_stop();
   drawFlashes();
   
   mapeditor::draw_dtshapes();
@@ -4785,7 +4784,7 @@ EX void drawthemap() {
     lmouseover = mousedest.d >= 0 ? cwt.at->modmove(cwt.spin + mousedest.d) : cwt.at;
     }
   #endif
-  profile_stop(0);
+  profile_stop();
   }
 
 EX void drawmovestar(double dx, double dy) {
@@ -4976,14 +4975,14 @@ EX void drawfullmap() {
     if(cmode & sm::DRAW) mapeditor::drawGrid();
 #endif
     }
-  profile_start(2);
+  profile_start("drawaura+drawqueue");
 
   drawaura();
   #if CAP_QUEUE
   drawqueue();
   #endif
 
-  profile_stop(2);
+  profile_stop();
   }
 
 #if ISMOBILE
@@ -47,6 +47,7 @@ template<class T, class V, class... U> bool among(T x, V y, U... u) { return x==
 // functions and types used from the standard library
 using std::vector;
 using std::map;
+using std::unordered_map;
 using std::array;
 using std::sort;
 using std::multimap;
@@ -55,6 +56,7 @@ using std::string;
 using std::pair;
 using std::tuple;
 using std::shared_ptr;
+using std::weak_ptr;
 using std::make_shared;
 using std::min;
 using std::max;
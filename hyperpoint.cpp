@@ -104,6 +104,68 @@ struct hyperpoint : array<ld, MAXMDIM> {
     }    
   };
 
+#if CAP_SIMD && MAXMDIM == 4
+/** \brief SSE2 (or AVX, if enabled at compile time) kernels for the products of hr::transmatrix.
+ *
+ *  The sums are computed in the same order as in the scalar loops, so the results are exactly the same.
+ *  Both dim == 3 and dim == 4 are supported.
+ */
+namespace simd {
+
+typedef ld matrix_data[MAXMDIM][MAXMDIM];
+
+/** \brief R = T * U */
+inline void mul(matrix_data& R, const matrix_data& T, const matrix_data& U, int dim) {
+  #ifdef __AVX__
+  if(dim == 4) {
+    for(int i=0; i<4; i++) {
+      __m256d acc = _mm256_setzero_pd();
+      for(int k=0; k<4; k++)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set1_pd(T[i][k]), _mm256_loadu_pd(U[k])));
+      _mm256_storeu_pd(R[i], acc);
+      }
+    return;
+    }
+  #endif
+  for(int i=0; i<dim; i++) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    for(int k=0; k<dim; k++) {
+      __m128d t = _mm_set1_pd(T[i][k]);
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(t, _mm_loadu_pd(U[k])));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(t, _mm_loadu_pd(U[k]+2)));
+      }
+    _mm_storeu_pd(R[i], acc0);
+    if(dim == 4) _mm_storeu_pd(R[i]+2, acc1);
+    else _mm_store_sd(R[i]+2, acc1);
+    }
+  }
+
+/** \brief z = T * h */
+inline void mul(ld *z, const matrix_data& T, const ld *h, int dim) {
+  #ifdef __AVX__
+  if(dim == 4) {
+    __m256d acc = _mm256_setzero_pd();
+    for(int j=0; j<4; j++)
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set_pd(T[3][j], T[2][j], T[1][j], T[0][j]), _mm256_set1_pd(h[j])));
+    _mm256_storeu_pd(z, acc);
+    return;
+    }
+  #endif
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  for(int j=0; j<dim; j++) {
+    __m128d hj = _mm_set1_pd(h[j]);
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_set_pd(T[1][j], T[0][j]), hj));
+    acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_set_pd(dim == 4 ? T[3][j] : 0, T[2][j]), hj));
+    }
+  _mm_storeu_pd(z, acc0);
+  if(dim == 4) _mm_storeu_pd(z+2, acc1);
+  else _mm_store_sd(z+2, acc1);
+  }
+}
+#endif
+
 /** \brief A matrix acting on hr::hyperpoint 
  *
  *  Since we are using homogeneous coordinates for hr::hyperpoint,
@@ -118,20 +180,28 @@ struct transmatrix {
   
   inline friend hyperpoint operator * (const transmatrix& T, const hyperpoint& H) {
     hyperpoint z;
+    #if CAP_SIMD && MAXMDIM == 4
+    simd::mul(&z[0], T.tab, &H[0], MXDIM);
+    #else
     for(int i=0; i<MXDIM; i++) {
       z[i] = 0;
       for(int j=0; j<MXDIM; j++) z[i] += T[i][j] * H[j];
       }
+    #endif
     return z;
     }
 
   inline friend transmatrix operator * (const transmatrix& T, const transmatrix& U) {
     transmatrix R;
+    #if CAP_SIMD && MAXMDIM == 4
+    simd::mul(R.tab, T.tab, U.tab, MXDIM);
+    #else
     for(int i=0; i<MXDIM; i++) for(int j=0; j<MXDIM; j++) {
       R[i][j] = 0;
       for(int k=0; k<MXDIM; k++)
         R[i][j] += T[i][k] * U[k][j];
       }
+    #endif
     return R;
     }  
   };
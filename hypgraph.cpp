@@ -2439,14 +2439,14 @@ EX namespace dq {
     return bucketer(T.h) + unsigned(floor(T.shift*81527+.5));
     }
 
-  EX set<heptagon*> visited;
+  EX epoch_set<heptagon*> visited;
   EX void enqueue(heptagon *h, const shiftmatrix& T) {
     if(!h || visited.count(h)) { return; }
     visited.insert(h);
     drawqueue.emplace(h, T);
     }  
 
-  EX set<unsigned> visited_by_matrix;
+  EX epoch_set<unsigned> visited_by_matrix;
   EX void enqueue_by_matrix(heptagon *h, const shiftmatrix& T) {
     if(!h) return;
     unsigned b = bucketer(tC0(T));
@@ -2456,7 +2456,7 @@ EX namespace dq {
     }
 
   EX queue<pair<cell*, shiftmatrix>> drawqueue_c;
-  EX set<cell*> visited_c;
+  EX epoch_set<cell*> visited_c;
 
   EX void enqueue_c(cell *c, const shiftmatrix& T) {
     if(!c || visited_c.count(c)) { return; }
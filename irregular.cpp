@@ -25,6 +25,9 @@ EX int cellcount;
 struct cellinfo {
   cell *owner;
   map<cell*, transmatrix> relmatrices;
+  /** \brief indices of the cells in the nearby buckets, sorted */
+  vector<int> nearby;
+  /** \brief jpoints[k] is the position of cells[nearby[k]] relative to this cell */
   vector<hyperpoint> jpoints;
   hyperpoint p;
   transmatrix pusher, rpusher;
@@ -121,12 +124,42 @@ string status[5];
   
 EX hrmap *base;
 
+/** \brief the neighbor index: base cells in distance at most 2 from the given base cell
+ *
+ *  Voronoi neighbors must come from adjacent heptagons, so only the cells in these
+ *  buckets are needed to compute the relmatrices, the jpoints, and the placement.
+ *  The cache refers to the cells of base, so it must be cleared whenever base is replaced or dropped.
+ */
+map<cell*, vector<cell*>> nearby_bases_cache;
+
+vector<cell*>& nearby_bases(cell *c) {
+  auto& res = nearby_bases_cache[c];
+  if(res.empty()) {
+    res.push_back(c);
+    forCellEx(c1, c) {
+      res.push_back(c1);
+      forCellEx(c2, c1) res.push_back(c2);
+      }
+    sort(res.begin(), res.end());
+    res.erase(unique(res.begin(), res.end()), res.end());
+    }
+  return res;
+  }
+
+/** \brief the position of cells[j] relative to ci; cells[j] must be in the nearby buckets */
+EX hyperpoint jpoint_of(const cellinfo& ci, int j) {
+  return ci.jpoints[lower_bound(ci.nearby.begin(), ci.nearby.end(), j) - ci.nearby.begin()];
+  }
+
 EX euc::torus_config_full base_config;
 
 bool gridmaking;
 
 int rearrange_index;
 
+/** \brief SDL_GetTicks() when runlevel 0 was entered, for the status */
+int generation_start;
+
 bool cell_sorting;
 
 EX int bitruncations_requested = 1;
@@ -135,9 +168,8 @@ EX int bitruncations_performed = 0;
 int black_adjacent, white_three;
 
 void set_relmatrices(cellinfo& ci) {
-  auto& all = base->allcells();
   ci.relmatrices.clear();
-  for(auto c0: all) ci.relmatrices[c0] = calc_relative_matrix(c0, ci.owner, ci.p);
+  for(auto c0: nearby_bases(ci.owner)) ci.relmatrices[c0] = calc_relative_matrix(c0, ci.owner, ci.p);
   }
 
 void rebase(cellinfo& ci) {
@@ -156,9 +188,15 @@ void compute_jpoints() {
     ci.pusher = rgpushxto0(ci.p);
     ci.rpusher = gpushxto0(ci.p);
     
+    ci.nearby.clear();
     ci.jpoints.clear();
 
-    for(int j=0; j<isize(cells); j++) {
+    for(auto c0: nearby_bases(ci.owner))
+      for(int j: cells_of_heptagon[c0->master])
+        ci.nearby.push_back(j);
+    sort(ci.nearby.begin(), ci.nearby.end());
+
+    for(int j: ci.nearby) {
       auto &cj = cells[j];
       ci.jpoints.push_back(ci.rpusher * ci.relmatrices[cj.owner] * cj.p);
       }
@@ -264,6 +302,7 @@ bool step(int delta) {
   switch(runlevel) {
     case 0: {
 
+     generation_start = t;
      cells.clear();
      cells_of_heptagon.clear();
      cellindex.clear();
@@ -283,10 +322,10 @@ bool step(int delta) {
       }
      
     case 1: {
+      make_cells_of_heptagon();
       while(isize(cells) < cellcount) {
-        if(SDL_GetTicks() > t + 250) { make_cells_of_heptagon(); status[0] = its(isize(cells)) + " cells"; return false; }
-        cells.emplace_back();
-        cellinfo& s = cells.back();
+        if(SDL_GetTicks() > t + 250) { status[0] = its(isize(cells)) + " cells"; return false; }
+        cellinfo s {};
         s.patterndir = -1;
         ld bestval = 0;
         for(int j=0; j<place_attempts; j++) {
@@ -294,20 +333,25 @@ bool step(int delta) {
           cell *c = all[k];
           map<cell*, transmatrix> relmatrices;
           hyperpoint h = randomPointIn(c->type);
-          for(auto c0: all) relmatrices[c0] = calc_relative_matrix(c0, c, h);
           ld mindist = 1e6;
-          for(auto p: cells) {
-            if(!relmatrices.count(p.owner)) continue;
-            ld val = hdist(h, relmatrices[p.owner] * p.p);
-            if(val < mindist) mindist = val;
+          for(auto c0: nearby_bases(c)) {
+            auto& T = relmatrices[c0] = calc_relative_matrix(c0, c, h);
+            for(int i: cells_of_heptagon[c0->master]) {
+              ld val = hdist(h, T * cells[i].p);
+              if(val < mindist) mindist = val;
+              }
             }
           if(mindist > bestval) bestval = mindist, s.owner = c, s.p = h, s.relmatrices = move(relmatrices);
           }
+        auto& vc = cells_of_heptagon[s.owner->master];
+        s.localindex = isize(vc);
+        vc.push_back(isize(cells));
+        cells.push_back(move(s));
         }
       make_cells_of_heptagon();
       cell_sorting = true; bitruncations_performed = 0;
       runlevel++;
-      status[0] = "all " + its(isize(cells)) + " cells";
+      status[0] = "all " + its(isize(cells)) + " cells in " + fts((SDL_GetTicks() - generation_start) / 1000.) + " s";
       break;
       }
     
@@ -331,10 +375,12 @@ bool step(int delta) {
         p1.vertices.clear();
         p1.neid.clear();
     
+        /* j and k are indices in p1.nearby */
+        int me = lower_bound(p1.nearby.begin(), p1.nearby.end(), i) - p1.nearby.begin();
         int j = 0;
-        if(j == i) j = 1;
+        if(j == me) j = 1;
     
-        for(int k=0; k<isize(cells); k++) if(k != i) {
+        for(int k=0; k<isize(p1.nearby); k++) if(k != me) {
           if(hdist(p1.jpoints[k], C0) < hdist(p1.jpoints[j], C0))
             j = k;
           }
@@ -346,7 +392,7 @@ bool step(int delta) {
         do {
           int best_k = -1;
           hyperpoint best_h;
-          for(int k=0; k<isize(cells); k++) if(k != i && k != j && k != oldj) {
+          for(int k=0; k<isize(p1.nearby); k++) if(k != me && k != j && k != oldj) {
             hyperpoint h = circumscribe(C0, p1.jpoints[j], p1.jpoints[k]);
             if(h[LDIM] < 0) continue;
             if(!clockwise(t, h)) continue;
@@ -356,7 +402,7 @@ bool step(int delta) {
               best_k = k, best_h = h;
             }
           p1.vertices.push_back(best_h);
-          p1.neid.push_back(best_k);
+          p1.neid.push_back(best_k == -1 ? -1 : p1.nearby[best_k]);
           distlens.push_back(hdist0(best_h));
           oldj = j, j = best_k, t = best_h;
           if(j == -1) break;
@@ -507,6 +553,7 @@ bool step(int delta) {
       */
 
       status[4] = XLAT("OK");
+      status[0] = "all " + its(isize(cells)) + " cells in " + fts((SDL_GetTicks() - generation_start) / 1000.) + " s";
       runlevel = 10;
       
       for(auto& s: cells) s.is_pseudohept = false;
@@ -599,7 +646,7 @@ EX void clear_links(heptagon *h) {
   for(cell *c: hi.subcells) {
     for(int i=0; i<c->type; i++) if(c->move(i)) c->move(i)->move(c->c.spin(i)) = NULL;
     cellindex.erase(c);
-    delete c;
+    destroy_cell(c);
     }
   h->c7 = NULL;
   periodmap.erase(h);
@@ -889,8 +936,8 @@ bool load_map(const string &fname) {
       double a, b, c;
       scan(f, a, b, c);
       s.p = hpxyz(a, b, c);
-      for(auto c0: all) s.relmatrices[c0] = calc_relative_matrix(c0, h, s.p);
       s.owner = h;
+      set_relmatrices(s);
       }
     }
 
@@ -901,6 +948,7 @@ bool load_map(const string &fname) {
 
 void cancel_map_creation() {
   base = NULL;
+  nearby_bases_cache.clear();
   runlevel = 0;
   popScreen();
   gridmaking = false;
@@ -1030,6 +1078,7 @@ EX void visual_creator() {
   start_game();
   if(base) delete base;
   base = currentmap; 
+  nearby_bases_cache.clear();
   base_config = euc::eu;
   drawthemap();
   cellcount = int(isize(base->allcells()) * density + .5);
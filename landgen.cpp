@@ -2773,6 +2773,7 @@ EX void setdist(cell *c, int d, cell *from) {
   if(fake::in()) return FPIU(setdist(c, d, from));
   
   if(c->mpdist <= d) return;
+  turn_timer tt(tpSetdist);
   if(c->mpdist > d+1 && d < BARLEV) setdist(c, d+1, from);
   c->mpdist = d;
   // printf("setdist %p %d [%p]\n", c, d, from);
@@ -17,6 +17,7 @@ namespace hr {
 #if HDR
 
 extern int cellcount, heptacount;
+extern size_t tailored_slab_bytes;
 
 #define NODIR 126
 #define NOBARRIERS 127
@@ -169,20 +170,94 @@ template<class T> struct connection_table {
     }
   };
 
+/** \brief A pool of blocks of the same size, used by tailored_alloc.
+ *
+ *  Exploring the hyperbolic world creates and destroys millions of cells and heptagons.
+ *  The pools carve them out of large slabs, so that the cells created together are close
+ *  in memory, and deleting a cell just puts it on the free list. The slabs are released
+ *  in clearCellMemory, once all the maps are deleted.
+ *
+ *  Not thread-safe: cells and heptagons are created and deleted only in the main thread.
+ */
+struct tailored_pool {
+  /** \brief the size of a block */
+  int block;
+  /** \brief the number of blocks in a slab */
+  int per_slab;
+  /** \brief the number of blocks in use */
+  int live;
+  /** \brief the slabs allocated */
+  vector<char*> slabs;
+  /** \brief the unused part of the last slab */
+  char *next, *end;
+  /** \brief the freed blocks; each of them contains the pointer to the next one */
+  void *free_list;
+
+  void *allocate() {
+    live++;
+    if(free_list) {
+      void *res = free_list;
+      free_list = *(void**) res;
+      return res;
+      }
+    if(next == end) {
+      next = new char[per_slab * block];
+      end = next + per_slab * block;
+      slabs.push_back(next);
+      tailored_slab_bytes += per_slab * block;
+      }
+    void *res = next;
+    next += block;
+    return res;
+    }
+
+  void deallocate(void *p) {
+    live--;
+    *(void**) p = free_list;
+    free_list = p;
+    }
+
+  /** \brief release the slabs, unless some blocks are still in use */
+  void release() {
+    if(live) return;
+    for(char *s: slabs) delete[] s;
+    tailored_slab_bytes -= isize(slabs) * per_slab * block;
+    slabs.clear();
+    next = end = nullptr;
+    free_list = nullptr;
+    }
+  };
+
+/** \brief the pools used by tailored_alloc<T>, one for every degree */
+template<class T> struct tailored_pools {
+  static tailored_pool pool[FULL_EDGE+1];
+  static void release() { for(auto& p: pool) p.release(); }
+  };
+
+template<class T> tailored_pool tailored_pools<T>::pool[FULL_EDGE+1];
+
 /** \brief Allocate a class T with a connection_table, but with only `degree` connections. 
  *
  *  Also set yet unknown connections to NULL.
  *
  * Generating the hyperbolic world consumes lots of
  * RAM, so we really need to be careful on low memory devices. 
+ * The memory comes from tailored_pools<T>. Define NO_TAILORED_ALLOC to use
+ * plain new and delete instead, e.g., for memory debugging tools.
  */
 
 template<class T> T* tailored_alloc(int degree) {
   const T* sample = (T*) &degree;
   T* result;
 #ifndef NO_TAILORED_ALLOC
-  int b = (char*)&sample->c.move_table[degree] + degree - (char*) sample;
-  result = (T*) new char[b];
+  auto& pool = tailored_pools<T>::pool[degree];
+  if(!pool.block) {
+    int b = (char*)&sample->c.move_table[degree] + degree - (char*) sample;
+    int a = max<int>(alignof(T), alignof(void*));
+    pool.block = (max<int>(b, sizeof(void*)) + a - 1) / a * a;
+    pool.per_slab = max(1, (1<<16) / pool.block);
+    }
+  result = (T*) pool.allocate();
   new (result) T();
 #else
   result = new T;
@@ -194,8 +269,13 @@ template<class T> T* tailored_alloc(int degree) {
 
 /** \brief Counterpart to hr::tailored_alloc(). */
 template<class T> void tailored_delete(T* x) {
+#ifndef NO_TAILORED_ALLOC
+  int degree = x->degree();
   x->~T();  
-  delete[] ((char*) (x));
+  tailored_pools<T>::pool[degree].deallocate(x);
+#else
+  delete x;
+#endif
   }
 
 static const struct wstep_t { wstep_t() {} } wstep;
@@ -63,38 +63,99 @@ EX namespace sn {
   inline hyperpoint decompress(compressed_point p) { return point3(p[0], p[1], p[2]); }
   inline compressed_point compress(hyperpoint h) { return make_array<float>(h[0], h[1], h[2]); }
 
+  /** \brief the header of the geodesic table files; the table of compressed_points follows directly */
+  struct geodesic_table_header {
+    char magic[4];
+    int version;
+    int PRECX, PRECY, PRECZ;
+    };
+
+  static const int geodesic_table_version = 1;
+
   struct tabled_inverses {
     int PRECX, PRECY, PRECZ;
+    /** the table: points either to tab or into mapping */
+    compressed_point *data;
     vector<compressed_point> tab;
+    shared_ptr<mapped_file> mapping;
     string fname;
     bool loaded;
     
     void load();
+    void allocate(int X, int Y, int Z);
+    void make_writable();
+    void write(const string& s);
     hyperpoint get(ld ix, ld iy, ld iz, bool lazy);
+    void get_batch(int n, const hyperpoint *ixyz, hyperpoint *res, bool lazy);
     
-    compressed_point& get_int(int ix, int iy, int iz) { return tab[(iz*PRECY+iy)*PRECX+ix]; }
+    compressed_point& get_int(int ix, int iy, int iz) { return data[(iz*PRECY+iy)*PRECX+ix]; }
   
     GLuint texture_id;
     bool toload;
     
     GLuint get_texture_id();
   
-    tabled_inverses(string s) : fname(s), texture_id(0), toload(true) {}  
+    tabled_inverses(string s) : data(nullptr), fname(s), loaded(false), texture_id(0), toload(true) {}  
     };
   #endif
   
+  /** the table is mapped read-only from the file, so there is a single copy in memory (shared with other processes) */
   void tabled_inverses::load() {
     if(loaded) return;
-    FILE *f = fopen(fname.c_str(), "rb");
-    if(!f) f = fopen((rsrcdir + fname).c_str(), "rb");
-    if(!f) { addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return; }
-    ignore(fread(&PRECX, 4, 1, f));
-    ignore(fread(&PRECY, 4, 1, f));
-    ignore(fread(&PRECZ, 4, 1, f));
-    tab.resize(PRECX * PRECY * PRECZ);
-    ignore(fread(&tab[0], sizeof(compressed_point) * PRECX * PRECY * PRECZ, 1, f));
+    auto m = map_file(fname);
+    if(!m) m = map_file(rsrcdir + fname);
+    if(!m) { addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return; }
+    const char *start;
+    if(m->size >= sizeof(geodesic_table_header) && memcmp(m->data, "HRGT", 4) == 0) {
+      auto& h = *(const geodesic_table_header*) m->data;
+      if(h.version != geodesic_table_version) {
+        println(hlog, fname, ": unsupported geodesic table version ", h.version);
+        addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return;
+        }
+      PRECX = h.PRECX; PRECY = h.PRECY; PRECZ = h.PRECZ;
+      start = m->data + sizeof(h);
+      }
+    else {
+      /* old format, without the magic and version */
+      if(m->size < 3 * sizeof(int)) { addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return; }
+      memcpy(&PRECX, m->data, sizeof(int));
+      memcpy(&PRECY, m->data + sizeof(int), sizeof(int));
+      memcpy(&PRECZ, m->data + 2 * sizeof(int), sizeof(int));
+      start = m->data + 3 * sizeof(int);
+      }
+    if(start + sizeof(compressed_point) * PRECX * PRECY * PRECZ > m->data + m->size) {
+      println(hlog, fname, ": geodesic table truncated");
+      addMessage(XLAT("geodesic table missing")); pmodel = mdPerspective; return;
+      }
+    mapping = m;
+    tab.clear();
+    data = (compressed_point*) start;
+    loaded = true;
+    }
+  
+  void tabled_inverses::allocate(int X, int Y, int Z) {
+    PRECX = X; PRECY = Y; PRECZ = Z;
+    mapping = nullptr;
+    tab.resize(X*Y*Z);
+    data = &tab[0];
+    loaded = true;
+    }
+
+  /** the mapped table is read-only; copy it into tab if it needs to be modified */
+  void tabled_inverses::make_writable() {
+    if(!mapping) return;
+    tab.assign(data, data + PRECX * PRECY * PRECZ);
+    data = &tab[0];
+    mapping = nullptr;
+    }
+
+  void tabled_inverses::write(const string& s) {
+    FILE *f = fopen(s.c_str(), "wb");
+    if(!f) { println(hlog, "could not write ", s); return; }
+    geodesic_table_header h = {{'H', 'R', 'G', 'T'}, geodesic_table_version, PRECX, PRECY, PRECZ};
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(data, sizeof(compressed_point) * PRECX * PRECY * PRECZ, 1, f);
     fclose(f);
-    loaded = true;    
     }
   
   hyperpoint tabled_inverses::get(ld ix, ld iy, ld iz, bool lazy) {
@@ -131,6 +192,59 @@ EX namespace sn {
     return res;
     }
   
+  /** \brief compute get for n points at once; ixyz[i] contains the arguments ix, iy, iz
+   *
+   *  With AVX2, eight points are interpolated at once (in single precision, as the table is in single precision anyway),
+   *  gathering the corners directly from the compressed table.
+   */
+  void tabled_inverses::get_batch(int n, const hyperpoint *ixyz, hyperpoint *res, bool lazy) {
+    int i = 0;
+    #if CAP_SIMD && defined(__AVX2__)
+    if(!lazy) {
+      const float *base = &data[0][0];
+      const __m256i one = _mm256_set1_epi32(1);
+      const __m256 lim_x = _mm256_set1_ps(PRECX-1), lim_z = _mm256_set1_ps(PRECZ-1);
+      const __m256 clamp_x = _mm256_set1_ps(PRECX-2), clamp_z = _mm256_set1_ps(PRECZ-2);
+      const __m256i step_y = _mm256_set1_epi32(3 * PRECX), step_z = _mm256_set1_epi32(3 * PRECX * PRECY);
+      const __m256i step_x = _mm256_set1_epi32(3);
+      for(; i+8 <= n; i+=8) {
+        alignas(32) float fx[8], fy[8], fz[8];
+        for(int j=0; j<8; j++) fx[j] = ixyz[i+j][0], fy[j] = ixyz[i+j][1], fz[j] = ixyz[i+j][2];
+        __m256 x = _mm256_mul_ps(_mm256_load_ps(fx), lim_x);
+        __m256 y = _mm256_mul_ps(_mm256_load_ps(fy), _mm256_set1_ps(PRECY-1));
+        __m256 z = _mm256_mul_ps(_mm256_load_ps(fz), lim_z);
+        /* the same clamping as in get */
+        x = _mm256_blendv_ps(x, clamp_x, _mm256_cmp_ps(x, lim_x, _CMP_GE_OQ));
+        y = _mm256_blendv_ps(y, clamp_x, _mm256_cmp_ps(y, lim_x, _CMP_GE_OQ));
+        z = _mm256_blendv_ps(z, clamp_z, _mm256_cmp_ps(z, lim_z, _CMP_GE_OQ));
+        __m256i ax = _mm256_cvttps_epi32(x), ay = _mm256_cvttps_epi32(y), az = _mm256_cvttps_epi32(z);
+        __m256 wx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(ax));
+        __m256 wy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(ay));
+        __m256 wz = _mm256_sub_ps(z, _mm256_cvtepi32_ps(az));
+        __m256 vx = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(ax, one)), x);
+        __m256 vy = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(ay, one)), y);
+        __m256 vz = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(az, one)), z);
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(ax, step_x), _mm256_add_epi32(_mm256_mullo_epi32(ay, step_y), _mm256_mullo_epi32(az, step_z)));
+        alignas(32) float out[3][8];
+        for(int t=0; t<3; t++) {
+          const float *b = base + t;
+          auto s0 = [&] (__m256i offset) { return _mm256_i32gather_ps(b, _mm256_add_epi32(idx, offset), 4); };
+          auto s1 = [&] (__m256i offset) {
+            return _mm256_add_ps(_mm256_mul_ps(s0(offset), vz), _mm256_mul_ps(s0(_mm256_add_epi32(offset, step_z)), wz));
+            };
+          auto s2 = [&] (__m256i offset) {
+            return _mm256_add_ps(_mm256_mul_ps(s1(offset), vy), _mm256_mul_ps(s1(_mm256_add_epi32(offset, step_y)), wy));
+            };
+          __m256 r = _mm256_add_ps(_mm256_mul_ps(s2(_mm256_setzero_si256()), vx), _mm256_mul_ps(s2(step_x), wx));
+          _mm256_store_ps(out[t], r);
+          }
+        for(int j=0; j<8; j++) res[i+j] = point3(out[0][j], out[1][j], out[2][j]);
+        }
+      }
+    #endif
+    for(; i<n; i++) res[i] = get(ixyz[i][0], ixyz[i][1], ixyz[i][2], lazy);
+    }
+
   GLuint tabled_inverses::get_texture_id() {
     if(!toload) return texture_id;
   
@@ -151,20 +265,13 @@ EX namespace sn {
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     
-    auto xbuffer = new glvertex[PRECZ*PRECY*PRECX];
-    
-    for(int z=0; z<PRECZ*PRECY*PRECX; z++) {
-      auto& t = tab[z];
-      xbuffer[z] = glhr::makevertex(t[0], t[1], t[2]);
-      }
-    
     #if !ISWEB
-    glTexImage3D(GL_TEXTURE_3D, 0, 34836 /*GL_RGBA32F*/, PRECX, PRECX, PRECZ, 0, GL_RGBA, GL_FLOAT, xbuffer);
+    /* upload straight from the table, alpha is set to 1 by OpenGL */
+    glTexImage3D(GL_TEXTURE_3D, 0, 34837 /*GL_RGB32F*/, PRECX, PRECY, PRECZ, 0, GL_RGB, GL_FLOAT, data);
     #else
-    // glTexStorage3D(GL_TEXTURE_3D, 1, 34836 /*GL_RGBA32F*/, PRECX, PRECX, PRECZ);
-    // glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, PRECX, PRECY, PRECZ, GL_RGBA, GL_FLOAT, xbuffer);
+    // glTexStorage3D(GL_TEXTURE_3D, 1, 34837 /*GL_RGB32F*/, PRECX, PRECX, PRECZ);
+    // glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, PRECX, PRECY, PRECZ, GL_RGB, GL_FLOAT, data);
     #endif
-    delete[] xbuffer;    
     return texture_id;
     }
   
@@ -548,6 +655,33 @@ EX namespace sn {
     return table_to_azeq(res);
     }
 
+  /** \brief get_inverse_exp_symsol or get_inverse_exp_nsym for n points at once, using tabled_inverses::get_batch */
+  EX void get_inverse_exp_batch(int n, const hyperpoint *h, hyperpoint *res, flagtype flags) {
+    auto& s = get_tabled();
+    s.load();
+    static vector<hyperpoint> ixyz;
+    ixyz.resize(n);
+    for(int i=0; i<n; i++) {
+      auto& hi = h[i];
+      ld ix = hi[0] >= 0. ? sn::x_to_ix(hi[0]) : sn::x_to_ix(-hi[0]);
+      ld iy = hi[1] >= 0. ? sn::x_to_ix(hi[1]) : sn::x_to_ix(-hi[1]);
+      ld iz = sn::z_to_iz(hi[2]);
+      if(!nih && hi[2] < 0.) { iz = -iz; swap(ix, iy); }
+      ixyz[i] = point3(ix, iy, iz);
+      }
+
+    s.get_batch(n, &ixyz[0], res, flags & pfNO_INTERPOLATION);
+
+    for(int i=0; i<n; i++) {
+      auto& hi = h[i];
+      auto& r = res[i];
+      if(!nih && hi[2] < 0.) { swap(r[0], r[1]); r[2] = -r[2]; }
+      if(hi[0] < 0.) r[0] = -r[0];
+      if(hi[1] < 0.) r[1] = -r[1];
+      if(!(flags & pfNO_DISTANCE)) r = table_to_azeq(r);
+      }
+    }
+
   EX hyperpoint get_inverse_exp_nsym(hyperpoint h, flagtype flags) {
     auto& s = get_tabled();
     s.load();
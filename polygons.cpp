@@ -1160,14 +1160,22 @@ void geometry_information::configure_floorshapes() {
   }
 
 void geometry_information::prepare_shapes() {
+  if(generate_shapes()) initPolyForGL();
+  }
+
+/** \brief generate the shapes, without passing them to GL; returns false if there is nothing to pass */
+bool geometry_information::generate_shapes() {
+  profile_zone pz("prepare_shapes");
   require_basics();
-  if(cgflags & qRAYONLY) return;
+  if(cgflags & qRAYONLY) return false;
   #if MAXMDIM >= 4 && CAP_GL
   if(GDIM == 3 && !floor_textures) make_floor_textures();
   #endif
 
   if(fake::in()) { FPIU( cgi.require_shapes() ); }
 
+  if(load_shape_cache()) return true;
+
   symmetriesAt.clear();
   allshapes.clear();
   DEBBI(DF_POLY, ("buildpolys"));
@@ -1634,9 +1642,349 @@ void geometry_information::prepare_shapes() {
   finishshape();
   prehpc = isize(hpc);
 
-  initPolyForGL();
+  save_shape_cache();
+  return true;
   }
 
+/** \brief generate the shapes on a worker thread while the main loop keeps the window alive (-shapes-bg) */
+EX bool shapes_in_background = false;
+
+#if CAP_THREAD
+/** \brief a call to generate_shapes running on a worker thread
+ *
+ *  The worker fills the shapes of the cgi it was started for. While it runs, the main loop
+ *  only presents empty frames (see shapes_ready), so that cgip, geometry etc. stay unchanged.
+ */
+struct shape_job {
+  geometry_information *target;
+  std::thread worker;
+  std::atomic<bool> done;
+  bool has_shapes;
+  };
+
+unique_ptr<shape_job> running_shape_job;
+#endif
+
+EX geometry_information *shape_job_target() {
+  #if CAP_THREAD
+  if(running_shape_job) return running_shape_job->target;
+  #endif
+  return nullptr;
+  }
+
+/** \brief wait for the shape_job (if any), and pass its results to GL */
+EX void finish_shape_job() {
+  #if CAP_THREAD
+  if(!running_shape_job) return;
+  auto& job = *running_shape_job;
+  job.worker.join();
+  auto& g = *job.target;
+  g.state = (g.state &~ 4) | 2;
+  if(job.has_shapes) {
+    dynamicval<geometry_information*> gc(cgip, &g);
+    g.initPolyForGL();
+    }
+  running_shape_job = nullptr;
+  #endif
+  }
+
+void geometry_information::require_shapes() {
+  if(state & 2) return;
+  if(state & 4) { finish_shape_job(); return; }
+  state |= 2;
+  prepare_shapes();
+  }
+
+/** \brief like require_shapes, but may start a shape_job instead; returns true if the shapes are ready */
+bool geometry_information::request_shapes() {
+  if(state & 2) return true;
+  #if CAP_THREAD
+  if(state & 4) return false;
+  if(shapes_in_background && GDIM == 2 && !hybri && !fake::in()) {
+    require_basics();
+    state |= 4;
+    running_shape_job.reset(new shape_job);
+    auto& job = *running_shape_job;
+    job.target = this;
+    job.done = false;
+    job.worker = std::thread([this, &job] { job.has_shapes = generate_shapes(); job.done = true; });
+    return false;
+    }
+  #endif
+  require_shapes();
+  return true;
+  }
+
+/** \brief called by the main loop: are the shapes for the current frame ready?
+ *
+ *  If not, a shape_job is running, and the frame should not touch any geometry-related state.
+ */
+EX bool shapes_ready() {
+  #if CAP_THREAD
+  if(running_shape_job) {
+    if(!running_shape_job->done) return false;
+    finish_shape_job();
+    return true;
+    }
+  #endif
+  if(!shapes_in_background) return true;
+  check_cgi();
+  return cgi.request_shapes();
+  }
+
+/** \brief the directory where the shapes generated by prepare_shapes are cached (-shape-cache); not used if empty */
+EX string shape_cache_dir;
+
+/** increase whenever prepare_shapes or the cache format changes */
+static const int shape_cache_version = 1;
+
+/** \brief the named hpcshape members of geometry_information, as ranges of memory which can be copied directly */
+vector<pair<hpcshape*, hpcshape*>> geometry_information::shape_ranges() {
+  return {
+    {&shSemiFloorSide[0], &shDodeca + 1},
+    {&shFrogRearFoot, &shFrogJumpLeg + 1},
+    {&shAnimatedEagle[0], &shAnimatedBat2[0] + WINGS + 1},
+    {&shFullCross[0], &shFullCross[0] + 2}
+    };
+  }
+
+/** \brief the number of hpcshapes declared in each of the ranges of shape_ranges; update when adding shapes to geometry_information */
+static const int shape_range_sizes[4] = { SIDEPARS + 471, 10, 9 * (WINGS+1), 2 };
+
+/** \brief do the ranges of shape_ranges consist of hpcshapes only?
+ *
+ *  If another member was declared inside a range, load_shape_cache would overwrite it, so the cache is not used then.
+ */
+bool shape_ranges_valid(geometry_information& g) {
+  auto ranges = g.shape_ranges();
+  for(int i=0; i<isize(ranges); i++)
+    if((char*) ranges[i].second - (char*) ranges[i].first != shape_range_sizes[i] * ptrdiff_t(sizeof(hpcshape))) {
+      println(hlog, "shape cache disabled: shape range ", i, " is not contiguous, update shape_range_sizes");
+      return false;
+      }
+  return true;
+  }
+
+/** only 2D geometries whose shapes depend just on cgi_string() are cached */
+bool shape_cache_usable() {
+  if(shape_cache_dir == "" || GDIM == 3 || hybri || fake::in() || arb::in()) return false;
+  static bool ranges_valid = shape_ranges_valid(cgi);
+  if(!ranges_valid) return false;
+  #if CAP_IRR
+  if(IRREGULAR) return false;
+  #endif
+  return true;
+  }
+
+string shape_cache_file(const string& key) {
+  return shape_cache_dir + "/" + itsh(unsigned(std::hash<string>()(key))) + ".hsc";
+  }
+
+/** reads a mapped shape cache file */
+struct shape_cache_stream : hstream {
+  const char *at, *end;
+  shape_cache_stream(const char *at, const char *end) : at(at), end(end) {}
+  virtual void write_char(char c) override { throw hstream_exception(); }
+  virtual char read_char() override { if(at == end) throw hstream_exception(); return *at++; }
+  virtual void read_chars(char* c, size_t q) override {
+    if(size_t(end - at) < q) throw hstream_exception();
+    memcpy(c, at, q); at += q;
+    }
+  };
+
+template<class T> void hwrite_rawvec(hstream& hs, const vector<T>& v) {
+  hs.write<int>(isize(v));
+  hs.write_chars((const char*) v.data(), sizeof(T) * v.size());
+  }
+
+template<class T> void hread_rawvec(hstream& hs, vector<T>& v) {
+  v.resize(hs.get<int>());
+  hs.read_chars((char*) v.data(), sizeof(T) * v.size());
+  }
+
+/** hpcshape::tinf is not saved; shapes with textures are not cacheable */
+void hwrite_shapes(hstream& hs, const vector<hpcshape>& v, bool& ok) {
+  for(auto& sh: v) if(sh.tinf) ok = false;
+  hwrite_rawvec(hs, v);
+  }
+
+void hread_shapes(hstream& hs, vector<hpcshape>& v) {
+  hread_rawvec(hs, v);
+  for(auto& sh: v) sh.tinf = nullptr;
+  }
+
+void hwrite_floorshape(hstream& hs, const floorshape& fsh, bool& ok) {
+  hwrite(hs, fsh.is_plain, fsh.shapeid, fsh.id, fsh.pstrength, fsh.fstrength, fsh.prio);
+  hwrite_shapes(hs, fsh.b, ok);
+  hwrite_shapes(hs, fsh.shadow, ok);
+  for(auto& v: fsh.side) hwrite_shapes(hs, v, ok);
+  for(auto& v: fsh.levels) hwrite_shapes(hs, v, ok);
+  for(auto& v: fsh.cone) hwrite_shapes(hs, v, ok);
+  for(auto& vv: fsh.gpside) {
+    hs.write<int>(isize(vv));
+    for(auto& v: vv) hwrite_shapes(hs, v, ok);
+    }
+  }
+
+void hread_floorshape(hstream& hs, floorshape& fsh) {
+  hread(hs, fsh.is_plain, fsh.shapeid, fsh.id, fsh.pstrength, fsh.fstrength, fsh.prio);
+  hread_shapes(hs, fsh.b);
+  hread_shapes(hs, fsh.shadow);
+  for(auto& v: fsh.side) hread_shapes(hs, v);
+  for(auto& v: fsh.levels) hread_shapes(hs, v);
+  for(auto& v: fsh.cone) hread_shapes(hs, v);
+  for(auto& vv: fsh.gpside) {
+    vv.resize(hs.get<int>());
+    for(auto& v: vv) hread_shapes(hs, v);
+    }
+  }
+
+void write_shape_cache_header(hstream& hs, const string& key) {
+  hwrite(hs, string("HyperRogue shape cache"), string(VER), shape_cache_version);
+  hwrite(hs, int(sizeof(hpcshape)), int(sizeof(hyperpoint)), int(sizeof(floorshape)), key);
+  }
+
+void geometry_information::save_shape_cache() {
+  if(!shape_cache_usable()) return;
+  string key = cgi_string();
+  shstream hs;
+  write_shape_cache_header(hs, key);
+  bool ok = true;
+
+  hwrite(hs, SD3, SD6, SD7, S12, S14, S21, S28, S42, S36, S84, prehpc);
+  hwrite(hs, wormscale, tentacle_length, sword_size, corner_bonus);
+  for(ld x: asteroid_size) hwrite(hs, x);
+  for(int k=0; k<SIDEPARS; k++) hwrite(hs, dlow_table[k], dhi_table[k], dfloor_table[k], validsidepar[k]);
+  hwrite_rawvec(hs, hpc);
+  hwrite_rawvec(hs, symmetriesAt);
+
+  auto ranges = shape_ranges();
+  for(auto r: ranges) hwrite_shapes(hs, vector<hpcshape>(r.first, r.second), ok);
+  vector<pair<int, int>> named;
+  for(auto sh: allshapes)
+    for(int i=0; i<isize(ranges); i++)
+      if(sh >= ranges[i].first && sh < ranges[i].second)
+        named.emplace_back(i, sh - ranges[i].first);
+  hwrite_rawvec(hs, named);
+
+  hs.write<int>(isize(all_plain_floorshapes));
+  for(auto sh: all_plain_floorshapes) hwrite_floorshape(hs, *sh, ok), hwrite(hs, sh->rad0, sh->rad1);
+  hs.write<int>(isize(all_escher_floorshapes));
+  for(auto sh: all_escher_floorshapes) hwrite_floorshape(hs, *sh, ok), hwrite(hs, sh->shapeid0, sh->shapeid1, sh->noftype, sh->shapeid2, sh->scale);
+
+  #if CAP_GP
+  hs.write<char>(!!gpdata);
+  if(gpdata) {
+    hwrite_raw(hs, gpdata->pshid);
+    hs.write(gpdata->nextid);
+    }
+  #else
+  hs.write<char>(0);
+  #endif
+
+  if(!ok) return;
+  string fname = shape_cache_file(key);
+  string tmpname = fname + ".tmp";
+  FILE *f = fopen(tmpname.c_str(), "wb");
+  if(!f) return;
+  bool written = fwrite(hs.s.data(), hs.s.size(), 1, f) == 1;
+  fclose(f);
+  if(!written || rename(tmpname.c_str(), fname.c_str())) remove(tmpname.c_str());
+  }
+
+bool geometry_information::load_shape_cache() {
+  if(!shape_cache_usable()) return false;
+  string key = cgi_string();
+  auto mf = map_file(shape_cache_file(key));
+  if(!mf) return false;
+
+  shstream expected;
+  write_shape_cache_header(expected, key);
+  if(mf->size < expected.s.size() || memcmp(mf->data, expected.s.data(), expected.s.size())) return false;
+  shape_cache_stream hs(mf->data + expected.s.size(), mf->data + mf->size);
+
+  /* read everything first, so that a broken file leaves cgi unchanged */
+  int sd[11];
+  ld scalars[4], asteroids[8], tables[SIDEPARS][3];
+  bool valid[SIDEPARS];
+  vector<hyperpoint> nhpc;
+  vector<array<int, 3>> nsym;
+  auto ranges = shape_ranges();
+  vector<vector<hpcshape>> shapes(isize(ranges));
+  vector<pair<int, int>> named;
+  vector<plain_floorshape> plain;
+  vector<escher_floorshape> escher;
+  char has_gp;
+  try {
+    for(int& i: sd) hread(hs, i);
+    for(ld& x: scalars) hread(hs, x);
+    for(ld& x: asteroids) hread(hs, x);
+    for(int k=0; k<SIDEPARS; k++) hread(hs, tables[k][0], tables[k][1], tables[k][2], valid[k]);
+    hread_rawvec(hs, nhpc);
+    hread_rawvec(hs, nsym);
+    for(int i=0; i<isize(ranges); i++) {
+      hread_shapes(hs, shapes[i]);
+      if(isize(shapes[i]) != ranges[i].second - ranges[i].first) return false;
+      }
+    hread_rawvec(hs, named);
+    plain.resize(hs.get<int>());
+    for(auto& sh: plain) hread_floorshape(hs, sh), hread(hs, sh.rad0, sh.rad1);
+    escher.resize(hs.get<int>());
+    for(auto& sh: escher) hread_floorshape(hs, sh), hread(hs, sh.shapeid0, sh.shapeid1, sh.noftype, sh.shapeid2, sh.scale);
+    hread(hs, has_gp);
+    }
+  catch(hstream_exception& e) { return false; }
+
+  init_floorshapes();
+  if(isize(plain) != isize(all_plain_floorshapes) || isize(escher) != isize(all_escher_floorshapes)) return false;
+  #if CAP_GP
+  if(bool(has_gp) != bool(gpdata)) return false;
+  if(gpdata) {
+    try {
+      hread_raw(hs, gpdata->pshid);
+      hread(hs, gpdata->nextid);
+      }
+    catch(hstream_exception& e) { return false; }
+    }
+  #else
+  if(has_gp) return false;
+  #endif
+
+  DEBBI(DF_POLY, ("loading shapes from the cache"));
+  int *sdv[11] = {&SD3, &SD6, &SD7, &S12, &S14, &S21, &S28, &S42, &S36, &S84, &prehpc};
+  for(int i=0; i<11; i++) *sdv[i] = sd[i];
+  wormscale = scalars[0]; tentacle_length = scalars[1]; sword_size = scalars[2]; corner_bonus = scalars[3];
+  for(int i=0; i<8; i++) asteroid_size[i] = asteroids[i];
+  for(int k=0; k<SIDEPARS; k++) {
+    dlow_table[k] = tables[k][0], dhi_table[k] = tables[k][1], dfloor_table[k] = tables[k][2];
+    validsidepar[k] = valid[k];
+    }
+  hpc = std::move(nhpc);
+  symmetriesAt = std::move(nsym);
+  for(int i=0; i<isize(ranges); i++) copy(shapes[i].begin(), shapes[i].end(), ranges[i].first);
+  allshapes.clear();
+  for(auto p: named) allshapes.push_back(ranges[p.first].first + p.second);
+  for(int i=0; i<isize(plain); i++) {
+    auto& sh = *all_plain_floorshapes[i];
+    (floorshape&) sh = std::move(plain[i]);
+    sh.rad0 = plain[i].rad0, sh.rad1 = plain[i].rad1;
+    }
+  for(int i=0; i<isize(escher); i++) *all_escher_floorshapes[i] = std::move(escher[i]);
+  last = NULL;
+  first = false;
+  return true;
+  }
+
+#if CAP_COMMANDLINE
+auto shape_cache_hook = 
+  addHook(hooks_args, 100, [] () {
+    using namespace arg;
+    if(argis("-shape-cache")) { shift(); shape_cache_dir = args(); return 0; }
+    else if(argis("-shapes-bg")) { shift(); shapes_in_background = argi(); return 0; }
+    else return 1;
+    });
+#endif
+
 EX vector<long double> polydata = {
 // shStarFloor[0] (6x1)
 NEWSHAPE,   1,6,1, 0.267355,0.153145, 0.158858,0.062321, 0.357493,-0.060252,
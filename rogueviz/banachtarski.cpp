@@ -301,7 +301,7 @@ void bantar_frame() {
 
   calcparam();
   
-  vector<unique_ptr<drawqueueitem>> subscr[4];
+  draw_queue subscr[4];
   
   compute_graphical_distance();
 
@@ -392,14 +392,14 @@ void bantar_frame() {
     subscr[i] = move(ptds);
     }
   
-  map<int, map<int, vector<unique_ptr<drawqueueitem>>>> xptds;
+  map<int, map<int, vector<drawqueueitem*>>> xptds;
   for(int i=0; i<4; i++) for(auto& p: subscr[i])
-    xptds[int(p->prio)][i].push_back(move(p));
+    xptds[int(p->prio)][i].push_back(p);
 
   for(auto& sm: xptds) for(auto& sm2: sm.second) {
     int i = sm2.first;
     ptds.clear();
-    for(auto& p: sm2.second) ptds.push_back(move(p));
+    for(auto& p: sm2.second) ptds.push_back(p);
 
     pconf.scale = .5;
     pconf.xposition = (!(i&2)) ? xdst : -xdst;
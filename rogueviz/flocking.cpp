@@ -19,19 +19,22 @@
 #ifdef USE_THREADS
 #include <thread>
 int threads = 1;
+#else
+const int threads = 1;
 #endif
 
-template<class T> auto parallelize(long long N, T action) -> decltype(action(0,0)) {
+/* action(a, b, k) processes the range [a, b) as the k-th of the threads */
+template<class T> auto parallelize(long long N, T action) -> decltype(action(0,0,0)) {
 #ifndef USE_THREADS
-  return action(0,N);
+  return action(0,N,0);
 #else
-  if(threads == 1) return action(0,N);
+  if(threads == 1) return action(0,N,0);
   std::vector<std::thread> v;
-  typedef decltype(action(0,0)) Res;
+  typedef decltype(action(0,0,0)) Res;
   std::vector<Res> results(threads);
   for(int k=0; k<threads; k++)
     v.emplace_back([&,k] () { 
-      results[k] = action(N*k/threads, N*(k+1)/threads); 
+      results[k] = action(N*k/threads, N*(k+1)/threads, k); 
       });
   for(std::thread& t:v) t.join();
   Res res = 0;
@@ -55,7 +58,13 @@ namespace flocking {
   int follow = 0;
   string follow_names[3] = {"nothing", "specific boid", "center of mass"};
   
-  map<cell*, map<cell*, transmatrix>> relmatrices;
+  /** \brief the cells of the map, and their indices */
+  vector<cell*> cells;
+  map<cell*, int> cell_index;
+
+  /** \brief the relmatrices of cells[i] are rel_matrix[k] for k in [rel_start[i], rel_start[i+1]); they lead to cells[rel_cell[k]] */
+  vector<int> rel_start, rel_cell;
+  vector<transmatrix> rel_matrix;
 
   ld ini_speed = .5;
   ld max_speed = 1;
@@ -73,7 +82,19 @@ namespace flocking {
   
   char shape = 'b';
   
-  vector<tuple<shiftpoint, shiftpoint, color_t> > lines;
+  typedef tuple<shiftpoint, shiftpoint, color_t> flockline;
+
+  vector<flockline> lines;
+
+  /** \brief lines produced by each thread, merged into lines after the step */
+  vector<vector<flockline>> line_buffers;
+
+  /** \brief the boid grid: the boids on cells[c] are bucket_boids[k] for k in [bucket_start[c], bucket_start[c+1]) */
+  vector<int> boid_cell, bucket_start, bucket_pos, bucket_boids;
+
+  /** \brief the results of a step, applied after all the boids are computed */
+  vector<transmatrix> pats, oris;
+  vector<ld> vels;
   
   // parameters of each boid
   // m->base: the cell it is currently on
@@ -94,21 +115,29 @@ namespace flocking {
     
     const auto v = currentmap->allcells();
     
+    cells = v;
+    cell_index.clear();
+    for(int i=0; i<isize(cells); i++) cell_index[cells[i]] = i;
+
     printf("computing relmatrices...\n");
-    // relmatrices[c1][c2] is the matrix we have to multiply by to 
+    // rel_matrix[k] is the matrix we have to multiply by to 
     // change from c1-relative coordinates to c2-relative coordinates
+    rel_start.clear(); rel_cell.clear(); rel_matrix.clear();
     for(cell* c1: v) {
+      rel_start.push_back(isize(rel_cell));
       manual_celllister cl;
       cl.add(c1);
       for(int i=0; i<isize(cl.lst); i++) {
         cell *c2 = cl.lst[i];
         transmatrix T = calc_relative_matrix(c2, c1, C0);
         if(hypot_d(WDIM, inverse_exp(shiftless(tC0(T)))) <= check_range) {
-          relmatrices[c1][c2] = T;
+          rel_cell.push_back(cell_index[c2]);
+          rel_matrix.push_back(T);
           forCellEx(c3, c2) cl.add(c3);
           }
         }
       }
+    rel_start.push_back(isize(rel_cell));
 
     printf("setting up...\n");
     for(int i=0; i<N; i++) {
@@ -139,22 +168,29 @@ namespace flocking {
       }      
     ld d = delta / 1000.;
     int N = isize(vdata);
-    vector<transmatrix> pats(N);
-    vector<transmatrix> oris(N);
-    vector<ld> vels(N);
-    using shmup::monster;
+    int C = isize(cells);
+    pats.resize(N);
+    oris.resize(N);
+    vels.resize(N);
     
-    map<cell*, vector<monster*>> monsat;
-
+    // bucket the boids by cells (counting sort)
+    boid_cell.resize(N);
+    bucket_start.assign(C+1, 0);
+    bucket_boids.resize(N);
     for(int i=0; i<N; i++) {
-      vertexdata& vd = vdata[i];
-      auto m = vd.m;
-      monsat[m->base].push_back(m);
+      boid_cell[i] = cell_index[vdata[i].m->base];
+      bucket_start[boid_cell[i]+1]++;
       }
+    for(int c=0; c<C; c++) bucket_start[c+1] += bucket_start[c];
+    bucket_pos = bucket_start;
+    for(int i=0; i<N; i++) bucket_boids[bucket_pos[boid_cell[i]]++] = i;
     
-    lines.clear();
+    line_buffers.resize(threads);
+    for(auto& lb: line_buffers) lb.clear();
 
-    parallelize(N, [&monsat, &d, &vels, &pats, &oris] (int a, int b) { for(int i=a; i<b; i++) {
+    parallelize(N, [&d] (int a, int b, int k) { 
+      auto& lb = line_buffers[k];
+      for(int i=a; i<b; i++) {
       vertexdata& vd = vdata[i];
       auto m = vd.m;
       
@@ -189,11 +225,13 @@ namespace flocking {
       hyperpoint coh = hpxyz(0, 0, 0);
       int coh_count = 0;
       
-      for(auto& p: relmatrices[m->base]) {
-        auto f = monsat.find(p.first);
-        if(f != monsat.end()) for(auto m2: f->second) if(m != m2) {
+      int c1 = boid_cell[i];
+      for(int r=rel_start[c1]; r<rel_start[c1+1]; r++) {
+        int c2 = rel_cell[r];
+        for(int q=bucket_start[c2]; q<bucket_start[c2+1]; q++) if(bucket_boids[q] != i) {
+          auto m2 = vdata[bucket_boids[q]].m;
           ld vel2 = m2->vel;
-          transmatrix at2 = I * p.second * m2->at;
+          transmatrix at2 = I * rel_matrix[r] * m2->at;
 
           // at2 is like m2->at but relative to m->at
           
@@ -231,7 +269,7 @@ namespace flocking {
             }
           
           if(col && draw_lines)
-            lines.emplace_back(m->pat * C0, m->pat * at2 * C0, col);          
+            lb.emplace_back(m->pat * C0, m->pat * at2 * C0, col);
           }
         }
       
@@ -266,6 +304,9 @@ namespace flocking {
         }
       
       } return 0; });
+    
+    lines.clear();
+    for(auto& lb: line_buffers) lines.insert(lines.end(), lb.begin(), lb.end());
       
     for(int i=0; i<N; i++) {
       vertexdata& vd = vdata[i];
@@ -15,12 +15,30 @@ int columns;
 typedef vector<double> kohvec;
 
 struct sample {
-  kohvec val;
+  /** this sample's row of the sample matrix */
+  const float *val;
   string name;
   };
 
 vector<sample> data;
 
+/** the sample matrix, unless it is mapped from a binary sample file */
+vector<float> sample_values;
+
+/** the binary sample file the sample matrix comes from */
+shared_ptr<mapped_file> sample_file;
+
+/** the binary sample format: this header, then rows*columns floats
+ *  (row-major), then the names of the rows, each terminated by 0 and
+ *  starting with '!' for the samples to show. Native byte order.
+ */
+struct binary_sample_header {
+  char magic[4];
+  int columns, rows, reserved;
+  };
+
+const char *binary_sample_magic = "KSM1";
+
 map<int, int> sample_vdata_id;
 
 int whattodraw[3] = {-2,-2,-2};
@@ -28,13 +46,14 @@ int whattodraw[3] = {-2,-2,-2};
 int min_group = 10, max_group = 10;
 
 struct neuron {
-  kohvec net;
+  /** this neuron's row of netmatrix */
+  double *net;
   cell *where;
   double udist;
   int lpbak;
   color_t col;
   int allsamples, drawn_samples, csample, bestsample, max_group_here;
-  neuron() { drawn_samples = allsamples = bestsample = 0; max_group_here = max_group; }
+  neuron() { net = NULL; drawn_samples = allsamples = bestsample = 0; max_group_here = max_group; }
   };
 
 vector<string> colnames;
@@ -43,10 +62,19 @@ kohvec weights;
 
 vector<neuron> net;
 
+/** weights of all the neurons, as one row-major matrix with a row of columns values per neuron */
+vector<double> netmatrix;
+
 int neuronId(neuron& n) { return &n - &(net[0]); }
 
 void alloc(kohvec& k) { k.resize(columns); }
 
+/** zero netmatrix and point every neuron to its row */
+void alloc_net() {
+  netmatrix.assign(size_t(isize(net)) * columns, 0);
+  for(int i=0; i<isize(net); i++) net[i].net = netmatrix.data() + size_t(i) * columns;
+  }
+
 bool neurons_indexed = false;
 
 int samples;
@@ -67,7 +95,7 @@ void normalize() {
     }
   }
 
-double vnorm(kohvec& a, kohvec& b) {
+template<class T1, class T2> double vnorm(const T1 *a, const T2 *b) {
   double diff = 0;
   for(int k=0; k<columns; k++) diff += sqr((a[k]-b[k]) * weights[k]);
   return diff;
@@ -80,36 +108,131 @@ bool noshow = false;
 
 vector<int> samples_to_show;
 
-void loadsamples(const string& fname) {
+/** read a row of cols values and a name from a text sample file */
+bool scan_sample(fhstream& f, int cols, float *val, string& name, bool& shown) {
+  name = ""; shown = false;
+  if(feof(f.f)) return false;
+  for(int i=0; i<cols; i++) {
+    double d;
+    if(!scan(f, d)) return false;
+    val[i] = d;
+    }
+  fgetc(f.f);
+  while(true) {
+    int c = fgetc(f.f);
+    if(c == -1 || c == 10 || c == 13) break;
+    if(c == '!' && name == "") shown = true;
+    else if(c != 32 && c != 9) name += c;
+    }
+  return true;
+  }
+
+bool is_binary_samples(const string& fname) {
+  FILE *f = fopen(fname.c_str(), "rb");
+  if(!f) return false;
+  char magic[4];
+  bool res = fread(magic, 4, 1, f) == 1 && memcmp(magic, binary_sample_magic, 4) == 0;
+  fclose(f);
+  return res;
+  }
+
+bool load_text_samples(const string& fname) {
   fhstream f(fname, "rt");
   if(!f.f) {
     fprintf(stderr, "Could not load samples: %s\n", fname.c_str());
-    return;
+    return false;
     }
   if(!scan(f, columns)) { 
     printf("Bad format: %s\n", fname.c_str());
-    return; 
+    return false; 
     }
   printf("Loading samples: %s\n", fname.c_str());
+  vector<float> val(columns);
   while(true) {
     sample s;
-    bool shown = false;
-    alloc(s.val);
-    if(feof(f.f)) break;
-    for(int i=0; i<columns; i++)
-      if(!scan(f, s.val[i])) { goto bigbreak; }
-    fgetc(f.f);
-    while(true) {
-      int c = fgetc(f.f);
-      if(c == -1 || c == 10 || c == 13) break;
-      if(c == '!' && s.name == "") shown = true;
-      else if(c != 32 && c != 9) s.name += c;
-      }
+    bool shown;
+    if(!scan_sample(f, columns, val.data(), s.name, shown)) break;
+    sample_values.insert(sample_values.end(), val.begin(), val.end());
     data.push_back(move(s));
     if(shown) 
       samples_to_show.push_back(isize(data)-1);
     }
-  bigbreak:
+  for(int i=0; i<isize(data); i++) data[i].val = sample_values.data() + size_t(i) * columns;
+  return true;
+  }
+
+/** use a binary sample file directly as the sample matrix */
+bool load_binary_samples(const string& fname) {
+  auto mf = map_file(fname);
+  binary_sample_header h;
+  if(!mf || mf->size < sizeof(h)) {
+    fprintf(stderr, "Could not load samples: %s\n", fname.c_str());
+    return false;
+    }
+  memcpy(&h, mf->data, sizeof(h));
+  size_t names_at = sizeof(h) + sizeof(float) * size_t(h.rows) * h.columns;
+  if(h.columns <= 0 || h.rows < 0 || mf->size < names_at) {
+    printf("Bad format: %s\n", fname.c_str());
+    return false;
+    }
+  printf("Mapping samples: %s\n", fname.c_str());
+  sample_file = mf;
+  columns = h.columns;
+  const float *matrix = (const float*) (mf->data + sizeof(h));
+  const char *at = mf->data + names_at, *end = mf->data + mf->size;
+  data.resize(h.rows);
+  for(int i=0; i<h.rows; i++) {
+    data[i].val = matrix + size_t(i) * columns;
+    const char *e = (const char*) memchr(at, 0, end - at);
+    if(!e) e = end;
+    if(at < e && *at == '!') samples_to_show.push_back(i), at++;
+    data[i].name.assign(at, e);
+    at = min(e+1, end);
+    }
+  return true;
+  }
+
+/** convert a text sample file to the binary format */
+void convert_samples(const string& from, const string& to) {
+  fhstream f(from, "rt");
+  if(!f.f) {
+    fprintf(stderr, "Could not load samples: %s\n", from.c_str());
+    return;
+    }
+  binary_sample_header h;
+  memcpy(h.magic, binary_sample_magic, 4);
+  h.rows = h.reserved = 0;
+  if(!scan(f, h.columns)) {
+    printf("Bad format: %s\n", from.c_str());
+    return;
+    }
+  FILE *g = fopen(to.c_str(), "wb");
+  if(!g) {
+    fprintf(stderr, "Could not save samples: %s\n", to.c_str());
+    return;
+    }
+  hr::ignore(fwrite(&h, sizeof(h), 1, g));
+  vector<float> val(h.columns);
+  string name, names;
+  bool shown;
+  while(scan_sample(f, h.columns, val.data(), name, shown)) {
+    hr::ignore(fwrite(val.data(), sizeof(float), h.columns, g));
+    if(shown) names += '!';
+    names += name;
+    names += char(0);
+    h.rows++;
+    }
+  hr::ignore(fwrite(names.data(), 1, names.size(), g));
+  fseek(g, 0, SEEK_SET);
+  hr::ignore(fwrite(&h, sizeof(h), 1, g));
+  fclose(g);
+  printf("Converted %d samples: %s\n", h.rows, to.c_str());
+  }
+
+void loadsamples(const string& fname) {
+  data.clear(); sample_values.clear(); sample_file = nullptr;
+  samples_to_show.clear(); sample_vdata_id.clear();
+  if(!(is_binary_samples(fname) ? load_binary_samples(fname) : load_text_samples(fname))) return;
   samples = isize(data);
   normalize();
   colnames.resize(columns);
@@ -126,14 +249,71 @@ int qpct = 100;
 int t, lpct, cells;
 double maxdist;
 
-neuron& winner(int id) {
+/** squared weights, for bmu_distance */
+kohvec weights2;
+
+/** the number of threads looking for the winners in find_winners */
+int threads = 1;
+
+/** the number of samples taken in a single step; their winners are found at once (in parallel) before the network is updated */
+int batch_size = 1;
+
+template<class T> void run_threads(int qty, const T& f) {
+  vector<std::thread> v;
+  for(int k=1; k<qty; k++) v.emplace_back([&f, k] { f(k); });
+  f(0);
+  for(auto& th: v) th.join();
+  }
+
+void prepare_search() {
+  alloc(weights2);
+  for(int k=0; k<columns; k++) weights2[k] = sqr(weights[k]);
+  }
+
+/** vnorm, with four independent sums so that the compiler can vectorize it; once the result is known to be at least bound, returns early */
+double bmu_distance(const double *a, const float *b, double bound) {
+  const double *w = weights2.data();
+  double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+  int k = 0;
+  while(k + 16 <= columns) {
+    for(int e=k+16; k<e; k+=4) {
+      d0 += sqr(a[k]-b[k]) * w[k];
+      d1 += sqr(a[k+1]-b[k+1]) * w[k+1];
+      d2 += sqr(a[k+2]-b[k+2]) * w[k+2];
+      d3 += sqr(a[k+3]-b[k+3]) * w[k+3];
+      }
+    if(d0+d1+d2+d3 >= bound) return d0+d1+d2+d3;
+    }
+  for(; k<columns; k++) d0 += sqr(a[k]-b[k]) * w[k];
+  return d0+d1+d2+d3;
+  }
+
+/** the id of the neuron closest to x; requires prepare_search() */
+int winner_id(const float *x) {
   double bdiff = HUGE_VAL;
-  neuron *bcell = NULL;
-  for(neuron& n: net) {
-    double diff = vnorm(n.net, data[id].val);
-    if(diff < bdiff) bdiff = diff, bcell = &n;
+  int best = 0;
+  const double *row = netmatrix.data();
+  for(int i=0; i<isize(net); i++, row += columns) {
+    double diff = bmu_distance(row, x, bdiff);
+    if(diff < bdiff) bdiff = diff, best = i;
     }
-  return *bcell;
+  return best;
+  }
+
+neuron& winner(int id) {
+  prepare_search();
+  return net[winner_id(data[id].val)];
+  }
+
+/** res[i] = the winner for the sample ids[i] */
+void find_winners(const vector<int>& ids, vector<int>& res) {
+  prepare_search();
+  int N = isize(ids);
+  res.resize(N);
+  int qty = max(min(threads, N / 16), 1);
+  run_threads(qty, [&] (int k) {
+    for(int i=N*k/qty; i<N*(k+1)/qty; i++) res[i] = winner_id(data[ids[i]].val);
+    });
   }
 
 void setindex(bool b) {
@@ -234,10 +414,12 @@ void distribute_neurons() {
   
   for(neuron& n: net) n.drawn_samples = 0, n.csample = 0;
   
-  for(auto p: sample_vdata_id) {
-    int s = p.first;
-    auto& w = winner(s);
-    whowon[s] = &w;
+  vector<int> ids, won;
+  for(auto p: sample_vdata_id) ids.push_back(p.first);
+  find_winners(ids, won);
+  for(int i=0; i<isize(ids); i++) {
+    auto& w = net[won[i]];
+    whowon[ids[i]] = &w;
     w.drawn_samples++;
     }
   
@@ -513,10 +695,8 @@ int krad;
 
 double ttpower = 1;
 
-void step() {
-
-  if(t == 0) return;
-  sominit(2);
+/** move the neurons around n towards the sample id */
+void learn(neuron& n, int id) {
   
   double tt = (t-1.) / tmax;
   tt = pow(tt, ttpower);
@@ -537,9 +717,6 @@ void step() {
         printf("t = %6d/%6d %3d%% dispid=%5d maxudist=%10.7lf\n", t, tmax, pct, dispid, maxudist);
       }
     }
-  int id = hrand(samples);
-  neuron& n = winner(id);
-  whowon.resize(samples);
   whowon[id] = &n;
     
   /* 
@@ -570,11 +747,32 @@ void step() {
     else
       nu *= *(it++);
 
+    double *row = n2->net;
+    const float *val = data[id].val;
     for(int k=0; k<columns; k++)
-      n2->net[k] += nu * (data[id].val[k] - n2->net[k]);
+      row[k] += nu * (val[k] - row[k]);
     }
   
   t--;
+  }
+
+void step() {
+
+  if(t == 0) return;
+  sominit(2);
+  whowon.resize(samples);
+  
+  if(batch_size <= 1) {
+    int id = hrand(samples);
+    learn(winner(id), id);
+    }
+  else {
+    vector<int> ids(min(batch_size, t)), won;
+    for(int& id: ids) id = hrand(samples);
+    find_winners(ids, won);
+    for(int i=0; i<isize(ids); i++) learn(net[won[i]], ids[i]);
+    }
+
   if(t == 0) analyze();
   }
 
@@ -681,10 +879,10 @@ void sominit(int initto, bool load_compressed) {
   
     cells = isize(allcells);
     net.resize(cells);
+    alloc_net();
     for(int i=0; i<cells; i++) net[i].where = allcells[i], allcells[i]->landparam = i;
     for(int i=0; i<cells; i++) {
       net[i].where->land = laCanvas;
-      alloc(net[i].net);
   
       if(samples)
       for(int k=0; k<columns; k++)
@@ -1018,13 +1216,17 @@ void do_classify() {
     printf("Classifying...\n");
     bids.resize(samples, 0);
     bdiffs.resize(samples, 1e20);
-    for(int s=0; s<samples; s++) {
-      for(int n=0; n<cells; n++) {
-        double diff = vnorm(net[n].net, data[s].val);
-        if(diff < bdiffs[s]) bdiffs[s] = diff, bids[s] = n, whowon[s] = &net[n];
+    vector<int> ids, won;
+    for(int s0=0; s0<samples; s0+=4096) {
+      ids.clear();
+      for(int s=s0; s<min(s0+4096, samples); s++) ids.push_back(s);
+      find_winners(ids, won);
+      for(int i=0; i<isize(ids); i++) {
+        int s = ids[i];
+        bids[s] = won[i];
+        bdiffs[s] = vnorm(net[won[i]].net, data[s].val);
         }
-      if(!(s % 128))
-        progress("Classifying: " + its(s) + "/" + its(samples));
+      progress("Classifying: " + its(s0) + "/" + its(samples));
       }
     }
   if(bdiffs.empty()) {
@@ -1308,11 +1510,14 @@ void load_compressed(string name) {
   // load data
   samples = f.get<int>();
   data.resize(samples);
+  sample_values.resize(size_t(samples) * columns);
+  sample_file = nullptr;
   int id = 0;
   for(auto& d: data) {
-    alloc(d.val);
+    float *val = sample_values.data() + size_t(id) * columns;
     for(int j=0; j<columns; j++)
-      d.val[j] = f.get_raw<float>();
+      val[j] = f.get_raw<float>();
+    d.val = val;
     f.read(d.name);
     int i = vdata.size();
     sample_vdata_id[id] = i;
@@ -1357,6 +1562,12 @@ int readArgs() {
     PHASE(3);
     shift(); kohonen::loadsamples(args());
     }
+  else if(argis("-som-convert")) {
+    // convert a text sample file to the binary format, which -som maps directly
+    PHASE(3);
+    shift(); string from = args();
+    shift(); kohonen::convert_samples(from, args());
+    }
 
   // #2: set parameters
 
@@ -1400,6 +1611,13 @@ int readArgs() {
     // this one can be changed at any moment
     shift_arg_formula(learning_factor);
     }
+  else if(argis("-somthreads")) {
+    shift(); threads = argi();
+    }
+  else if(argis("-sombatch")) {
+    // mini-batch mode: the winners for this many samples are found at once
+    shift(); batch_size = argi();
+    }
 
   else if(argis("-somrun")) {
     t = tmax; sominit(1);
@@ -1556,10 +1774,13 @@ auto hooks2 = addHook(hooks_frame, 50, levelline::draw)
 void clear() {
   printf("clearing Kohonen...\n");
   data.clear();
+  sample_values.clear();
+  sample_file = nullptr;
   sample_vdata_id.clear();
   colnames.clear();
   weights.clear();
   net.clear();
+  netmatrix.clear();
   whowon.clear();
   samples_to_show.clear();
   scc.clear();
@@ -26,10 +26,19 @@ namespace sag {
   int numsnake;
   const char *loadfname;
   
-  #define MAXSNAKETAB 1000
-  int sdist[MAXSNAKETAB][MAXSNAKETAB];
+  /** \brief distances between the first insnaketab snake cells, as a flat insnaketab x insnaketab matrix */
+  vector<unsigned short> sdist;
   int insnaketab = 0;
 
+  /** \brief the largest snake for which sdist is computed; in bounded geometries larger, since the fallback is slow there (-sagsdist)
+   *  the matrix takes 2*limit^2 bytes, and in bounded geometries every row is a BFS of the whole map
+   */
+  int sdist_limit = 2048, bounded_sdist_limit = 4096;
+
+  /** \brief for unbounded snakes: the snake ranges which contain the given cell, from the cell itself outwards; the ranges of cell i start at snakelabel[labelstart[i]] */
+  vector<pair<int, int>> snakelabel;
+  vector<int> labelstart;
+
   vector<cell*> snakecells;
   vector<int> snakefirst, snakelast;
   vector<int> snakenode;
@@ -62,19 +71,53 @@ namespace sag {
   void disable_snake() { if(snake_enabled) snakeswitch(); }
     
   int snakedist(int i, int j) {
-    if(i < insnaketab && j < insnaketab) return sdist[i][j];
+    if(i < insnaketab && j < insnaketab) return sdist[i * insnaketab + j];
     if(bounded) return celldistance(snakecells[i], snakecells[j]);
-    int i0 = i, i1 = i, j0 = j, j1 = j;
+    const pair<int, int> *a = &snakelabel[labelstart[i]], *b = &snakelabel[labelstart[j]];
     int cost = 0;
     // intersect
     while(true) {
-      if(j0 > i1+1) { j0 = snakefirst[j0], j1 = snakelast[j1]; cost++; }
-      else if(i0 > j1+1) { i0 = snakefirst[i0], i1 = snakelast[i1]; cost++; }
-      else if(j1+1 == i0) return cost+1;
-      else if(i1+1 == j0) return cost+1;
+      if(b->first > a->second+1) { b++; cost++; }
+      else if(a->first > b->second+1) { a++; cost++; }
+      else if(b->second+1 == a->first) return cost+1;
+      else if(a->second+1 == b->first) return cost+1;
       else return cost;
       }
     }
+
+  /** \brief compute snakelabel; a range is only left when its first cell is at least 2 */
+  void build_snakelabels() {
+    snakelabel.clear();
+    labelstart.resize(numsnake);
+    for(int i=0; i<numsnake; i++) {
+      labelstart[i] = isize(snakelabel);
+      int i0 = i, i1 = i;
+      snakelabel.emplace_back(i0, i1);
+      while(i0 >= 2) {
+        i0 = snakefirst[i0], i1 = snakelast[i1];
+        snakelabel.emplace_back(i0, i1);
+        }
+      }
+    }
+
+  void build_sdist() {
+    int stab = min(numsnake, bounded ? bounded_sdist_limit : sdist_limit);
+    insnaketab = 0;
+    sdist.assign(size_t(stab) * stab, 0xFFFF);
+    for(int i=0; i<stab; i++) {
+      unsigned short *row = &sdist[size_t(i) * stab];
+      if(bounded) {
+        celllister cl(snakecells[i], 0xFFFE, 100000000, NULL);
+        for(int k=0; k<isize(cl.lst); k++) {
+          cell *c = cl.lst[k];
+          if(c->wparam == INSNAKE && c->landparam < stab) row[c->landparam] = cl.dists[k];
+          }
+        }
+      for(int j=0; j<stab; j++)
+        if(row[j] == 0xFFFF) row[j] = snakedist(i, j);
+      }
+    insnaketab = stab;
+    }
   
   void initSnake(int n) {
     if(bounded) n = isize(currentmap->allcells());
@@ -108,22 +151,21 @@ namespace sag {
         setsnake(cw, i); cw += 1;
         }
       }
-    int stab = min(numsnake, MAXSNAKETAB);
-    for(int i=0; i<stab; i++)
-    for(int j=0; j<stab; j++)
-      sdist[i][j] = snakedist(i,j);
-    insnaketab = stab;
+    if(!bounded) build_snakelabels();
+    build_sdist();
     snake_enabled = true;
     }
   
-  double costat(int vid, int sid) {
+  /** \brief the cost of vertex vid placed at sid, in the assignment sids; the edges to skip1 and skip2 are ignored */
+  double costat(const vector<int>& sids, int vid, int sid, int skip1 = -1, int skip2 = -1) {
     if(vid < 0) return 0;
     double cost = 0;
     vertexdata& vd = vdata[vid];
     for(int j=0; j<isize(vd.edges); j++) {
       edgeinfo *ei = vd.edges[j].second;
       int t2 = vd.edges[j].first;
-      if(snakeid[t2] != -1) cost += snakedist(sid, snakeid[t2]) * ei->weight2;
+      if(t2 == skip1 || t2 == skip2) continue;
+      if(sids[t2] != -1) cost += snakedist(sid, sids[t2]) * ei->weight2;
       }
     /* cell *c = snakecells[id];
     for(int i=0; i<c->type; i++) {
@@ -133,6 +175,8 @@ namespace sag {
       } */
     return cost;
     }
+
+  double costat(int vid, int sid) { return costat(snakeid, vid, sid); }
   
   // std::mt19937 los;
 
@@ -150,63 +194,76 @@ namespace sag {
       vdata[id].edges[i].second->orig = NULL;
     }
   
-  bool chance(double p) {
-    p *= double(hrngen.max()) + 1;
-    auto l = hrngen();
+  template<class G> bool chance(G& gen, double p) {
+    p *= double(gen.max()) + 1;
+    auto l = gen();
     auto pv = (decltype(l)) p;
     if(l < pv) return true;
-    if(l == pv) return chance(p-pv);
+    if(l == pv) return chance(gen, p-pv);
     return false;
     }
 
-  void saiter() {
+  bool chance(double p) { return chance(hrngen, p); }
+
+  /** \brief choose a random move for saiter: vertex t1 is to be moved to sid2; rnd(n) gives random numbers in [0,n)
+   *  \return false if no move should be made in this iteration
+   */
+  template<class R> bool choose_move(const vector<int>& sids, const R& rnd, int& t1, int& sid2) {
     aiter:
 
-    int t1 = hrand(N);
-    int sid1 = snakeid[t1];
-    
-    int sid2;
+    t1 = rnd(N);
+    int sid1 = sids[t1];
     
-    int s = hrand(6);
+    int s = rnd(6);
     
     if(s == 3) s = 2;
     if(s == 4) s = 5;
     
-    if((sagpar&1) && (s == 2 || s == 3 || s == 4)) return;
+    if((sagpar&1) && (s == 2 || s == 3 || s == 4)) return false;
     
-    if(s == 5) sid2 = hrand(numsnake);
+    if(s == 5) sid2 = rnd(numsnake);
     
     else {
       cell *c;
-      if(s>=2 && isize(vdata[t1].edges)) c = snakecells[snakeid[hrand(isize(vdata[t1].edges))]];
+      if(s>=2 && isize(vdata[t1].edges)) c = snakecells[sids[rnd(isize(vdata[t1].edges))]];
       else c = snakecells[sid1];
       
       int it = s<2 ? (s+1) : s-2;
       for(int ii=0; ii<it; ii++) {
-        int d = hrand(c->type);
+        int d = rnd(c->type);
         c = c->move(d);
         if(!c) goto aiter;
         if(c->wparam != INSNAKE) goto aiter;
         }
       sid2 = c->landparam;
       }
+    return true;
+    }
+
+  /** \brief the change of cost if t1 (at sid1) and t2 (at sid2, -1 if none) swap their places */
+  double move_change(const vector<int>& sids, int t1, int sid1, int t2, int sid2) {
+    return 
+      costat(sids, t1, sid2, t1, t2) + costat(sids, t2, sid1, t1, t2) - costat(sids, t1, sid1, t1, t2) - costat(sids, t2, sid2, t1, t2);
+    }
+
+  void apply_move(vector<int>& sids, vector<int>& nodes, int t1, int sid1, int t2, int sid2) {
+    nodes[sid1] = t2; nodes[sid2] = t1;
+    sids[t1] = sid2; if(t2 >= 0) sids[t2] = sid1;
+    }
+
+  void saiter() {
+    int t1, sid2;
+    if(!choose_move(snakeid, [] (int n) { return hrand(n); }, t1, sid2)) return;
+    int sid1 = snakeid[t1];
     int t2 = snakenode[sid2];
     
-    snakenode[sid1] = -1; snakeid[t1] = -1;
-    snakenode[sid2] = -1; if(t2 >= 0) snakeid[t2] = -1;
-    
-    double change = 
-      costat(t1,sid2) + costat(t2,sid1) - costat(t1,sid1) - costat(t2,sid2);
-
-    snakenode[sid1] = t1; snakeid[t1] = sid1;
-    snakenode[sid2] = t2; if(t2 >= 0) snakeid[t2] = sid2;
+    double change = move_change(snakeid, t1, sid1, t2, sid2);
     
     if(change < 0) chgs.push_back(-change);
       
     if(change > 0 && (sagmode == sagHC || !chance(exp(-change * exp(-temperature))))) return;
 
-    snakenode[sid1] = t2; snakenode[sid2] = t1;
-    snakeid[t1] = sid2; if(t2 >= 0) snakeid[t2] = sid1;
+    apply_move(snakeid, snakenode, t1, sid1, t2, sid2);
     if(vdata[t1].m) vdata[t1].m->base = snakecells[sid2];
     if(t2 >= 0 && vdata[t2].m) vdata[t2].m->base = snakecells[sid1];
     cost += 2*change;
@@ -284,27 +341,209 @@ namespace sag {
     } */
   
   int ipturn = 100;
-  int numiter = 0;
+  long long numiter = 0;
   
   int hightemp = 10;
   int lowtemp = -15;
+
+  int sa_start, sa_last_report;
+
+  /** \brief print the cost as a function of the wall clock time in dofullsa, at most once per second unless forced */
+  void sa_report(double cost, bool force = false) {
+    int t = SDL_GetTicks();
+    if(!force && t < sa_last_report + 1000) return;
+    sa_last_report = t;
+    println(hlog, "SA time ", fts((t - sa_start) / 1000., 4), " iterations ", format("%lld", numiter), " temperature ", fts(temperature, 4), " cost ", fts(cost, 10));
+    }
+
+  /** \brief set the temperature according to the schedule of dofullsa, started at t1; false if the time is up */
+  bool sa_schedule(int t1, int satime) {
+    int t2 = SDL_GetTicks();
+    double d = (t2-t1) / (1000. * satime);
+    if(d > 1) return false;
+    temperature = hightemp - (d*(hightemp-lowtemp));
+    return true;
+    }
+
+  /** \brief update the display after many moves */
+  void update_bases() {
+    for(int i=0; i<N; i++) {
+      if(vdata[i].m) vdata[i].m->base = snakecells[snakeid[i]];
+      forgetedges(i);
+      }
+    shmup::fixStorage();
+    }
+
+  #if CAP_THREAD
+  /** \brief the number of replicas for parallel tempering in dofullsa (-sagpt); each replica runs on its own thread */
+  int replicas = 1;
+
+  /** \brief the difference of temperature between adjacent replicas */
+  ld replica_step = 1;
+
+  /** \brief the number of threads which evaluate non-conflicting moves concurrently in dofullsa (-sagthreads) */
+  int move_threads = 1;
+
+  /** \brief the number of iterations per replica or thread between the synchronizations (0 = automatic) */
+  int sync_iterations = 0;
+
+  /** \brief a copy of the SA state with its own random generator, for parallel tempering */
+  struct replica {
+    vector<int> snakeid, snakenode;
+    double cost;
+    ld temperature;
+    std::mt19937 gen;
+    };
+
+  /** \brief a move found by a worker thread in dofullsa_concurrent */
+  struct sa_move {
+    int t1, sid1, t2, sid2;
+    double change;
+    };
+
+  /** \brief can snakedist be called from the worker threads? not if it would have to call celldistance, which caches its results globally */
+  bool threads_allowed() {
+    if(bounded && insnaketab < numsnake) {
+      println(hlog, "the snake is larger than the distance table (", insnaketab, "), not using threads; increase -sagsdist");
+      return false;
+      }
+    return true;
+    }
+
+  template<class T> void run_threads(int qty, const T& f) {
+    vector<std::thread> threads;
+    for(int k=1; k<qty; k++) threads.emplace_back([&f, k] { f(k); });
+    f(0);
+    for(auto& th: threads) th.join();
+    }
+
+  void saiter_replica(replica& r, int iterations) {
+    auto rnd = [&r] (int n) { return int(r.gen() % n); };
+    ld mul = exp(-r.temperature);
+    for(int i=0; i<iterations; i++) {
+      int t1, sid2;
+      if(!choose_move(r.snakeid, rnd, t1, sid2)) continue;
+      int sid1 = r.snakeid[t1];
+      int t2 = r.snakenode[sid2];
+      double change = move_change(r.snakeid, t1, sid1, t2, sid2);
+      if(change > 0 && !chance(r.gen, exp(-change * mul))) continue;
+      apply_move(r.snakeid, r.snakenode, t1, sid1, t2, sid2);
+      r.cost += 2*change;
+      }
+    }
+
+  /** \brief parallel tempering: the coldest replica follows the schedule of dofullsa, and the others are replica_step, 2*replica_step, ... hotter */
+  void dofullsa_tempering(int satime) {
+    vector<replica> reps(replicas);
+    for(auto& r: reps) {
+      r.snakeid = snakeid; r.snakenode = snakenode; r.cost = cost;
+      r.gen.seed(hrngen());
+      }
+    int iterations = sync_iterations ? sync_iterations : 10000;
+    int t1 = SDL_GetTicks();
+    long long exchanges = 0, accepted = 0;
+    while(sa_schedule(t1, satime)) {
+      for(int k=0; k<replicas; k++) reps[k].temperature = temperature + k * replica_step;
+      run_threads(replicas, [&] (int k) { saiter_replica(reps[k], iterations); });
+      numiter += replicas * iterations;
+
+      /* the cost counts every edge twice, so the energy used for the acceptance in saiter is cost/2 */
+      for(int k=0; k+1<replicas; k++) {
+        auto& a = reps[k];
+        auto& b = reps[k+1];
+        ld delta = (exp(-a.temperature) - exp(-b.temperature)) * (a.cost - b.cost) / 2;
+        exchanges++;
+        if(delta < 0 && !chance(exp(delta))) continue;
+        swap(a.snakeid, b.snakeid); swap(a.snakenode, b.snakenode); swap(a.cost, b.cost);
+        accepted++;
+        }
+      sa_report(reps[0].cost);
+      }
+
+    replica *best = &reps[0];
+    for(auto& r: reps) if(r.cost < best->cost) best = &r;
+    snakeid = best->snakeid; snakenode = best->snakenode; cost = best->cost;
+    update_bases();
+    println(hlog, "replica exchanges accepted: ", format("%lld/%lld", accepted, exchanges));
+    }
+
+  /** \brief SA where move_threads threads look for moves on the same state; the moves which do not conflict with the moves made before are then made */
+  void dofullsa_concurrent(int satime) {
+    vector<std::mt19937> gens(move_threads);
+    for(auto& g: gens) g.seed(hrngen());
+    vector<vector<sa_move>> moves(move_threads);
+
+    /* a move conflicts if its vertices, or their neighbors, or its snake cells have been changed in this round */
+    vector<int> vstamp(N, 0), sstamp(numsnake, 0);
+    int stamp = 0;
+    long long made = 0, conflicts = 0;
+
+    /* at high temperatures most moves are made, so the batches must be small compared to N to avoid conflicts */
+    int iterations = sync_iterations ? sync_iterations : max(100, N / 20 / move_threads);
+
+    int t1 = SDL_GetTicks();
+    while(sa_schedule(t1, satime)) {
+      ld mul = exp(-temperature);
+      run_threads(move_threads, [&] (int k) {
+        auto& gen = gens[k];
+        auto rnd = [&gen] (int n) { return int(gen() % n); };
+        auto& res = moves[k];
+        res.clear();
+        for(int i=0; i<iterations; i++) {
+          sa_move m;
+          if(!choose_move(snakeid, rnd, m.t1, m.sid2)) continue;
+          m.sid1 = snakeid[m.t1];
+          m.t2 = snakenode[m.sid2];
+          m.change = move_change(snakeid, m.t1, m.sid1, m.t2, m.sid2);
+          if(m.change > 0 && !chance(gen, exp(-m.change * mul))) continue;
+          res.push_back(m);
+          }
+        });
+      numiter += move_threads * iterations;
+
+      stamp++;
+      for(auto& res: moves) for(auto& m: res) {
+        if(vstamp[m.t1] == stamp || (m.t2 >= 0 && vstamp[m.t2] == stamp) || sstamp[m.sid1] == stamp || sstamp[m.sid2] == stamp) {
+          conflicts++;
+          continue;
+          }
+        apply_move(snakeid, snakenode, m.t1, m.sid1, m.t2, m.sid2);
+        cost += 2*m.change;
+        made++;
+        sstamp[m.sid1] = sstamp[m.sid2] = stamp;
+        for(int t: {m.t1, m.t2}) if(t >= 0) {
+          vstamp[t] = stamp;
+          for(auto& e: vdata[t].edges) vstamp[e.first] = stamp;
+          }
+        }
+      sa_report(cost);
+      }
+
+    update_bases();
+    println(hlog, "moves made: ", format("%lld", made), " dropped due to conflicts: ", format("%lld", conflicts));
+    }
+  #endif
   
   void dofullsa(int satime) {
     sagmode = sagSA;
     enable_snake();
     int t1 = SDL_GetTicks();
-    
-    while(true) {
-      int t2 = SDL_GetTicks();
-      double d = (t2-t1) / (1000. * satime);
-      if(d > 1) break;
-      temperature = hightemp - (d*(hightemp-lowtemp));
+    sa_start = t1;
+    sa_report(cost, true);
+
+    #if CAP_THREAD
+    bool threads = (replicas > 1 || move_threads > 1) && threads_allowed();
+    if(threads && replicas > 1) dofullsa_tempering(satime);
+    else if(threads && move_threads > 1) dofullsa_concurrent(satime);
+    else
+    #endif
+    while(sa_schedule(t1, satime)) {
       chgs.clear();
       for(int i=0; i<50000; i++) {
         numiter++;
         sag::saiter();
         }
-      DEBB(DF_LOG, (format("it %8d temp %6.4f [1/e at %13.6f] cost = %f ", 
+      DEBB(DF_LOG, (format("it %8lld temp %6.4f [1/e at %13.6f] cost = %f ", 
         numiter, double(sag::temperature), (double) exp(sag::temperature),
         double(sag::cost))));
       
@@ -313,8 +552,10 @@ namespace sag {
       DEBB(DF_LOG, (format("%9.4f .. %9.4f .. %9.4f .. %9.4f .. %9.4f\n", 
         double(chgs[0]), double(chgs[cc/4]), double(chgs[cc/2]), double(chgs[cc*3/4]), double(chgs[cc]))));
       fflush(stdout);
+      sa_report(cost);
       }
     
+    sa_report(cost, true);
     temperature = -5;
     disable_snake();
     sagmode = sagOff;
@@ -334,12 +575,12 @@ namespace sag {
     if(t < 50) ipturn *= 2;
     else if(t > 200) ipturn /= 2;
     else ipturn = ipturn * 100 / t;
-    DEBB(DF_LOG, ("it %8d temp %6.4f [2:%8.6f,10:%8.6f,50:%8.6f] cost = %f\n", 
+    DEBB(DF_LOG, (format("it %8lld temp %6.4f [2:%8.6f,10:%8.6f,50:%8.6f] cost = %f\n", 
       numiter, double(sag::temperature), 
       (double) exp(-2 * exp(-sag::temperature)),
       (double) exp(-10 * exp(-sag::temperature)),
       (double) exp(-50 * exp(-sag::temperature)),
-      (double) sag::cost));
+      (double) sag::cost)));
     }
   
   void savesnake(const string& fname) {
@@ -511,6 +752,10 @@ int readArgs() {
     shift();
     sag::sagpar = argi();
     }
+// the largest snake in a bounded geometry with a full distance table (before -sag)
+  else if(argis("-sagsdist")) {
+    shift(); sag::bounded_sdist_limit = argi();
+    }
   else if(argis("-sag")) {
     PHASE(3); 
     shift(); sag::read(args());
@@ -523,6 +768,20 @@ int readArgs() {
   else if(argis("-fullsa")) {
     shift(); sag::dofullsa(argi());
     }
+  #if CAP_THREAD
+// (4a) parallel SA: -sagpt <replicas> <temperature step> for parallel tempering, or -sagthreads <threads> to look for moves concurrently
+  else if(argis("-sagpt")) {
+    shift(); sag::replicas = argi();
+    shift_arg_formula(sag::replica_step);
+    }
+  else if(argis("-sagthreads")) {
+    shift(); sag::move_threads = argi();
+    }
+// iterations per replica or thread between synchronizations
+  else if(argis("-sagsync")) {
+    shift(); sag::sync_iterations = argi();
+    }
+  #endif
 // (5) save the positioning
   else if(argis("-gsave")) {
     PHASE(3); shift(); sag::savesnake(args());
@@ -67,6 +67,8 @@ bool computed = false;
       }
     int dexp_id;
     dexp_data surface_point;
+    /** color class in the parallel solver, and the last sweep this point has been scheduled for */
+    int color, scheduled;
     };
 
   struct triangle {
@@ -127,10 +129,16 @@ EX ld scale = 1;
 EX ld anticusp_factor = 1;
 EX ld anticusp_dist;
 
-EX ld err_zero = 1e-3, err_zero_current, current_total_error;
+EX ld err_zero = 1e-3, err_zero_current;
+
+/** \brief the total error of the rug, as computed by the last call to physics() */
+EX ld current_total_error;
 
 EX int queueiter, qvalid, dt;
 
+/** \brief the number of threads used by physics(); with 1 thread, the queue-based solver is used */
+EX int threads = 1;
+
 EX rugpoint *finger_center;
 EX ld finger_range = .1;
 EX ld finger_force = 1;
@@ -165,6 +173,33 @@ bool rug_hyperbolic() { USING_NATIVE_GEOMETRY; return hyperbolic; }
 bool rug_sphere() { USING_NATIVE_GEOMETRY; return sphere; }
 bool rug_elliptic() { USING_NATIVE_GEOMETRY; return elliptic; }
 
+/** \brief spatial hash of the points added by addRugpoint, keyed by the quantized coordinates of rugpoint::h */
+unordered_map<long long, vector<rugpoint*>> point_hash;
+
+/** \brief the size of the cells of point_hash */
+const ld hash_cell = 1e-3;
+
+/** \brief findRugpoint looks for the points whose coordinates differ by at most this */
+const ld hash_margin = 1e-4;
+
+long long hash_coord(ld x) { return (long long) floor(x / hash_cell); }
+
+long long hash_key(unsigned long long x, unsigned long long y, unsigned long long z) {
+  return x * 73856093 ^ y * 19349663 ^ z * 83492791;
+  }
+
+/** \brief call f for the keys of all the cells of point_hash which intersect the box of radius margin around h (unshifted) */
+template<class T> void for_hash_cells(const hyperpoint& h, ld margin, const T& f) {
+  for(long long x = hash_coord(h[0] - margin); x <= hash_coord(h[0] + margin); x++)
+  for(long long y = hash_coord(h[1] - margin); y <= hash_coord(h[1] + margin); y++)
+  for(long long z = hash_coord(h[2] - margin); z <= hash_coord(h[2] + margin); z++)
+    f(hash_key(x, y, z));
+  }
+
+void add_to_hash(rugpoint *m) {
+  for_hash_cells(unshift(m->h), 0, [m] (long long key) { point_hash[key].push_back(m); });
+  }
+
 EX rugpoint *addRugpoint(shiftpoint h, double dist) {
   rugpoint *m = new rugpoint;
   m->h = h;
@@ -267,14 +302,25 @@ EX rugpoint *addRugpoint(shiftpoint h, double dist) {
   m->inqueue = false;
   m->dist = dist;
   points.push_back(m);
+  add_to_hash(m);
   return m;
   }
 
 EX rugpoint *findRugpoint(shiftpoint h) {
+  hyperpoint hh = unshift(h);
   USING_NATIVE_GEOMETRY;
-  for(int i=0; i<isize(points); i++) 
-    if(geo_dist_q(points[i]->h.h, unshift(h, points[i]->h.shift)) < 1e-5) return points[i];
-  return NULL;
+  rugpoint *res = nullptr;
+  auto check = [&] (const hyperpoint& at) {
+    for_hash_cells(at, hash_margin, [&] (long long key) {
+      auto it = point_hash.find(key);
+      if(it != point_hash.end()) for(auto p: it->second)
+        if(!res && geo_dist_q(p->h.h, unshift(h, p->h.shift)) < 1e-5) res = p;
+      });
+    };
+  check(hh);
+  /* in the elliptic plane, the antipodal point is the same point */
+  if(!res && elliptic) check(-hh);
+  return res;
   }
 
 EX rugpoint *findOrAddRugpoint(shiftpoint h, double dist) {
@@ -282,7 +328,25 @@ EX rugpoint *findOrAddRugpoint(shiftpoint h, double dist) {
   return r ? r : addRugpoint(h, dist);
   }
 
+#if CAP_THREAD
+/** \brief the number of points colored by the parallel solver, or -1 if there is no coloring */
+int colored_points = -1;
+
+/** \brief the endpoints of the edges added since the last coloring, whose colors have to be checked */
+vector<rugpoint*> recolor_points;
+#endif
+
+/** \brief tell the parallel solver that the colors of e1 and e2 may conflict now */
+void edge_added(rugpoint *e1, rugpoint *e2) {
+  #if CAP_THREAD
+  if(colored_points < 0) return;
+  recolor_points.push_back(e1);
+  recolor_points.push_back(e2);
+  #endif
+  }
+
 void addNewEdge(rugpoint *e1, rugpoint *e2, ld len = 1) {
+  edge_added(e1, e2);
   edge e; e.len = len;
   e.target = e2; e1->edges.push_back(e);
   e.target = e1; e2->edges.push_back(e);
@@ -303,6 +367,7 @@ void addEdge(rugpoint *e1, rugpoint *e2, ld len = 1) {
 void add_anticusp_edge(rugpoint *e1, rugpoint *e2, ld len = 1) {
   for(auto& e: e1->anticusp_edges)
     if(e.target == e2) return;
+  edge_added(e1, e2);
   edge e; e.len = len;
   e.target = e2; e1->anticusp_edges.push_back(e);
   e.target = e1; e2->anticusp_edges.push_back(e);
@@ -587,20 +652,26 @@ EX void buildRug() {
 
 queue<rugpoint*> pqueue;
 
+/** \brief in the worker threads of the parallel solver, enqueue adds the point to the list of points touched by this thread instead */
+thread_local vector<rugpoint*> *touched_list = nullptr;
+
 EX void enqueue(rugpoint *m) {
+  if(touched_list) { touched_list->push_back(m); return; }
   if(m->inqueue) return;
   pqueue.push(m);
   m->inqueue = true;
   }
 
+/** \brief where force() adds the error; the worker threads of the parallel solver use their own */
+thread_local ld *total_error = &current_total_error;
+
 bool force_euclidean(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp = false, double d1=1, double d2=1) {
   if(!m1.valid || !m2.valid) return false;
-  USING_NATIVE_GEOMETRY;
   // double rd = geo_dist_q(m1.h, m2.h) * xd;
   double t = sqhypot_d(3, m1.native - m2.native);
   if(is_anticusp && t > rd*rd) return false;
   t = sqrt(t);
-  current_total_error += (t-rd) * (t-rd);
+  *total_error += (t-rd) * (t-rd);
   bool nonzero = abs(t-rd) > err_zero_current;
   double force = (t - rd) / t / 2; // 20.0;
   for(int i=0; i<3; i++) {
@@ -612,16 +683,12 @@ bool force_euclidean(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp = f
   return nonzero;
   }
 
-bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
+/** \brief force() in the native geometry, which should be already set */
+bool force_native(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
   if(!m1.valid || !m2.valid) return false;
-  if(rug_euclid() && fast_euclidean) {
-    return force_euclidean(m1, m2, rd, is_anticusp, d1, d2);
-    }
-  USING_NATIVE_GEOMETRY;
-  
   ld t = geo_dist_q(m1.native, m2.native);
   if(is_anticusp && t > rd) return false;
-  current_total_error += (t-rd) * (t-rd);
+  *total_error += (t-rd) * (t-rd);
   bool nonzero = abs(t-rd) > err_zero_current;
   double forcev = (t - rd) / 2; // 20.0;
   
@@ -643,6 +710,15 @@ bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double
   return nonzero;
   }
 
+bool force(rugpoint& m1, rugpoint& m2, double rd, bool is_anticusp=false, double d1=1, double d2=1) {
+  if(!m1.valid || !m2.valid) return false;
+  if(rug_euclid() && fast_euclidean) {
+    return force_euclidean(m1, m2, rd, is_anticusp, d1, d2);
+    }
+  USING_NATIVE_GEOMETRY;
+  return force_native(m1, m2, rd, is_anticusp, d1, d2);
+  }
+
 vector<pair<ld, rugpoint*> > preset_points;
 
 EX void preset(rugpoint *m) {
@@ -926,6 +1002,265 @@ EX void addNewPoints() {
   if(qvalid != oqvalid) { println(hlog, "adding new points ", make_tuple(oqvalid, qvalid, isize(points), dist, dt, queueiter)); }
   }
 
+#if CAP_THREAD
+/** \brief the number of colors used by the parallel solver */
+int color_count;
+
+/** \brief for every color, the points to relax in the next sweep of the parallel solver */
+vector<vector<rugpoint*>> scheduled_points;
+
+int sweep_id;
+
+/** \brief make sure that the color of p differs from the points at distance at most 2
+ *
+ *  Points at distance at most 2 get different colors, since relaxing a point moves also its neighbors.
+ *  The color of p is kept if possible, otherwise the smallest free color is taken; returns true if it has changed.
+ */
+bool recolor(rugpoint *p) {
+  static vector<bool> used;
+  int old = p->color;
+  p->color = -1;
+  used.assign(color_count + 1, false);
+  auto mark = [&] (rugpoint *q) { if(q->color >= 0) used[q->color] = true; };
+  auto mark2 = [&] (rugpoint *q) {
+    mark(q);
+    for(auto& e: q->edges) mark(e.target);
+    for(auto& e: q->anticusp_edges) mark(e.target);
+    };
+  for(auto& e: p->edges) mark2(e.target);
+  for(auto& e: p->anticusp_edges) mark2(e.target);
+  if(old >= 0 && !used[old]) { p->color = old; return false; }
+  int c = 0;
+  while(used[c]) c++;
+  color_count = max(color_count, c+1);
+  p->color = c;
+  return true;
+  }
+
+/** \brief greedy coloring for the parallel solver
+ *
+ *  Only the points added since the last call, and the endpoints of the new edges, are (re)colored;
+ *  removing edges cannot create conflicts. Returns true if any color has changed.
+ */
+bool color_points() {
+  bool changed = false;
+  if(colored_points < 0) {
+    color_count = 0;
+    colored_points = 0;
+    recolor_points.clear();
+    for(auto p: points) p->color = -1, p->scheduled = -1;
+    }
+  for(int i=colored_points; i<isize(points); i++) {
+    points[i]->color = -1, points[i]->scheduled = -1;
+    recolor(points[i]);
+    changed = true;
+    }
+  colored_points = isize(points);
+  for(auto p: recolor_points) if(recolor(p)) changed = true;
+  recolor_points.clear();
+  scheduled_points.resize(color_count);
+  return changed;
+  }
+
+/** \brief schedule the point for the next sweep */
+void schedule(rugpoint *p) {
+  if(!p->valid || p->scheduled == sweep_id + 1) return;
+  p->scheduled = sweep_id + 1;
+  scheduled_points[p->color].push_back(p);
+  }
+
+/** \brief schedule the points which have been moved, and their neighbors */
+void schedule_touched(vector<rugpoint*>& touched) {
+  for(auto p: touched) {
+    schedule(p);
+    for(auto& e: p->edges) schedule(e.target);
+    for(auto& e: p->anticusp_edges) schedule(e.target);
+    }
+  touched.clear();
+  }
+
+struct spin_barrier {
+  int n;
+  std::atomic<int> count, generation;
+  spin_barrier(int n) : n(n), count(0), generation(0) {}
+  void wait() {
+    int g = generation.load();
+    if(count.fetch_add(1) == n-1) { count = 0; generation++; }
+    /* the workers of rug_pool wait here between the calls of physics(), so stop spinning after a while */
+    else for(int i=0; generation.load() == g; i++)
+      if(i < 1000) std::this_thread::yield();
+      else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  };
+
+/** \brief the worker threads of the parallel solver, kept between the calls of physics()
+ *
+ *  The workers are parked on the barrier; run() releases them to call job, and waits until all of them have
+ *  returned from it.
+ */
+struct rug_pool {
+  vector<std::thread> workers;
+  spin_barrier barrier;
+  std::function<void(int)> job;
+  bool quit;
+
+  rug_pool() : barrier(1), quit(false) {}
+  ~rug_pool() { stop(); }
+
+  int size() { return isize(workers) + 1; }
+
+  void start(int nt) {
+    stop();
+    barrier.n = nt;
+    quit = false;
+    for(int k=1; k<nt; k++) workers.emplace_back([this, k] {
+      while(true) {
+        barrier.wait();
+        if(quit) return;
+        job(k);
+        barrier.wait();
+        }
+      });
+    }
+
+  void stop() {
+    if(workers.empty()) return;
+    quit = true;
+    barrier.wait();
+    for(auto& w: workers) w.join();
+    workers.clear();
+    barrier.n = 1;
+    }
+
+  void run(const std::function<void(int)>& f) {
+    job = f;
+    barrier.wait();
+    job(0);
+    barrier.wait();
+    }
+  };
+
+rug_pool pool;
+
+/** \brief stop the worker threads of the parallel solver (they are started again when needed) */
+void stop_workers() { pool.stop(); }
+
+/** \brief sweeps over the scheduled points using the given number of threads
+ *
+ *  The points of each color are relaxed in parallel, taking them in chunks from an atomic counter.
+ *  Every point is relaxed exactly as in the queue-based solver, and the coloring ensures that no two
+ *  threads write the same point. Instead of the queue, the points moved in a sweep are scheduled, together
+ *  with their neighbors, for the next one.
+ *
+ *  Sweeps are done until the time budget is used up, or nothing is scheduled; returns true in the latter case.
+ *  current_total_error is set to the error of the last sweep.
+ */
+bool parallel_sweeps(int ticks) {
+  USING_NATIVE_GEOMETRY;
+  bool fe = euclid && fast_euclidean;
+  int nt = threads;
+  const int chunk = 64;
+  vector<ld> errors(nt, 0);
+  vector<vector<rugpoint*>> touched(nt);
+  vector<vector<rugpoint*>> current(color_count);
+  vector<std::atomic<int>> next(color_count);
+  std::atomic<bool> go_on(true), failed(false);
+  if(pool.size() != nt) pool.start(nt);
+  auto& barrier = pool.barrier;
+  bool converged = false;
+
+  auto start_sweep = [&] {
+    converged = true;
+    for(int c=0; c<color_count; c++) {
+      swap(current[c], scheduled_points[c]);
+      scheduled_points[c].clear();
+      next[c] = 0;
+      if(!current[c].empty()) converged = false;
+      }
+    sweep_id++;
+    };
+
+  auto relax = [&] (rugpoint& m, vector<rugpoint*>& t) {
+    bool moved = false;
+    for(auto& e: m.edges)
+      moved = (fe ? force_euclidean(m, *e.target, e.len) : force_native(m, *e.target, e.len)) || moved;
+    for(auto& e: m.anticusp_edges)
+      moved = (fe ? force_euclidean(m, *e.target, anticusp_dist, true) : force_native(m, *e.target, anticusp_dist, true)) || moved;
+    if(moved) t.push_back(&m);
+    };
+
+  auto work = [&] (int id) {
+    total_error = &errors[id];
+    touched_list = &touched[id];
+    while(true) {
+      for(int c=0; c<color_count; c++) {
+        auto& cls = current[c];
+        while(!failed) {
+          int a = next[c].fetch_add(chunk);
+          if(a >= isize(cls)) break;
+          int b = min(a + chunk, isize(cls));
+          try {
+            for(int i=a; i<b; i++) relax(*cls[i], touched[id]);
+            }
+          catch(rug_exception&) { failed = true; }
+          }
+        barrier.wait();
+        }
+      if(id == 0) {
+        ld err = 0;
+        for(int k=0; k<nt; k++) {
+          err += errors[k], errors[k] = 0;
+          if(!touched[k].empty()) need_mouseh = true;
+          schedule_touched(touched[k]);
+          }
+        current_total_error = err;
+        for(auto& cls: current) queueiter += isize(cls);
+        start_sweep();
+        go_on = !converged && !failed && int(SDL_GetTicks()) < ticks + 5 && !stop;
+        }
+      barrier.wait();
+      if(!go_on) break;
+      }
+    total_error = &current_total_error;
+    touched_list = nullptr;
+    };
+
+  start_sweep();
+  if(converged) return true;
+
+  pool.run(work);
+  if(failed) throw rug_exception();
+
+  /* keep the points which have not been relaxed yet */
+  if(!converged) for(int c=0; c<color_count; c++) for(int i=next[c]; i<isize(current[c]); i++) schedule(current[c][i]);
+  return converged;
+  }
+
+/** \brief move the points enqueued (by addNewPoints or subdivide) to the scheduled points */
+void schedule_queue() {
+  if(color_points()) {
+    /* the scheduled points may be in the lists of their old colors */
+    vector<rugpoint*> old;
+    for(auto& cls: scheduled_points) for(auto p: cls) old.push_back(p), p->scheduled = -1;
+    for(auto& cls: scheduled_points) cls.clear();
+    for(auto p: old) schedule(p);
+    }
+  while(!pqueue.empty()) {
+    auto p = pqueue.front(); pqueue.pop();
+    p->inqueue = false;
+    schedule(p);
+    }
+  }
+
+void physics_parallel(int ticks) {
+  while(int(SDL_GetTicks()) < ticks + 5 && !stop) {
+    schedule_queue();
+    if(!parallel_sweeps(ticks)) continue;
+    addNewPoints();
+    }
+  }
+#endif
+
 EX void physics() {
 
   #if CAP_CRYSTAL
@@ -940,6 +1275,14 @@ EX void physics() {
   auto t = SDL_GetTicks();
   
   current_total_error = 0;
+
+  #if CAP_THREAD
+  if(threads > 1) { physics_parallel(t); return; }
+  /* the coloring is not maintained by the queue-based solver */
+  colored_points = -1;
+  recolor_points.clear();
+  stop_workers();
+  #endif
   
   while(SDL_GetTicks() < t + 5 && !stop)
   for(int it=0; it<50 && !stop; it++)
@@ -1208,7 +1551,13 @@ EX void clear_model() {
   triangles.clear();
   for(int i=0; i<isize(points); i++) delete points[i];
   points.clear();
+  point_hash.clear();
   pqueue = queue<rugpoint*> ();
+  #if CAP_THREAD
+  scheduled_points.clear();
+  colored_points = -1;
+  recolor_points.clear();
+  #endif
   }
   
 EX void close() {
@@ -1216,6 +1565,9 @@ EX void close() {
   rugged = false;
   close_glbuf();
   finger_center = NULL;
+  #if CAP_THREAD
+  stop_workers();
+  #endif
   }
 
 int lastticks;
@@ -1809,6 +2161,11 @@ int rugArgs() {
     err_zero_current = err_zero;
     }
 
+  else if(argis("-rugthreads")) {
+    PHASEFROM(2);
+    shift(); threads = argi();
+    }
+
   else if(argis("-rugon")) {
     PHASE(3); 
     start_game();
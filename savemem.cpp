@@ -46,7 +46,7 @@ void slow_delete_cell(cell *c) {
     if(c->move(i))
       c->move(i)->move(c->c.spin(i)) = NULL;
   removed_cells.push_back(c);
-  delete c;
+  destroy_cell(c);
   }
 
 void delete_heptagon(heptagon *h2) {
@@ -60,7 +60,7 @@ void delete_heptagon(heptagon *h2) {
   for(int i=0; i<S7; i++)
     if(h2->move(i))
       h2->move(i)->move(h2->c.spin(i)) = NULL;
-  delete h2;
+  tailored_delete(h2);
   }
 
 void recursive_delete(heptagon *h, int i) {
@@ -94,6 +94,7 @@ bool unsafeLand(cell *c) {
   }
 
 EX void save_memory() {
+  turn_timer tt(tpSaveMemory);
   if(quotient || !hyperbolic || NONSTDVAR) return;
   if(!memory_saving_mode) return;
   if(unsafeLand(cwt.at)) return;
@@ -164,7 +165,7 @@ EX void save_memory() {
     }
   
   last_cleared = at1;
-  DEBB(DF_MEMORY, ("current cellcount = ", cellcount));
+  DEBB(DF_MEMORY, ("current cellcount = ", cellcount, " heptacount = ", heptacount, " slabs = ", int(tailored_slab_bytes >> 10), " KB"));
   
   sort(removed_cells.begin(), removed_cells.end());
   callhooks(hooks_removecells);
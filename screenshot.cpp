@@ -666,10 +666,160 @@ EX SDL_Surface *empty_surface(int x, int y, bool alpha) {
   }
 #endif
 
+#if CAP_VIDEO && CAP_THREAD
+/** \brief frames for rawfile_handle: the render thread fills a ring of frame buffers, and a writer thread drains them into the pipe */
+struct frame_ring {
+  vector<vector<char>> frames;
+  std::atomic<int> produced, consumed;
+  std::atomic<bool> finished;
+  std::thread writer;
+
+  frame_ring(int qty) : frames(qty) {
+    produced = consumed = 0; finished = false;
+    writer = std::thread([this] { run(); });
+    }
+
+  /** wait for a free frame buffer, of the given size */
+  char *acquire(int size) {
+    while(produced - consumed >= isize(frames))
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    auto& fr = frames[produced % isize(frames)];
+    fr.resize(size);
+    return fr.data();
+    }
+
+  /** the buffer from acquire is ready to write */
+  void publish() { produced++; }
+
+  void run() {
+    while(true) {
+      if(consumed < produced) {
+        auto& fr = frames[consumed % isize(frames)];
+        size_t at = 0;
+        while(at < fr.size()) {
+          auto w = write(rawfile_handle, fr.data() + at, fr.size() - at);
+          if(w <= 0) break;
+          at += w;
+          }
+        consumed++;
+        }
+      else if(finished) return;
+      else std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+
+  ~frame_ring() {
+    finished = true;
+    writer.join();
+    }
+  };
+
+/** \brief the number of frame buffers between the renderer and the video encoder */
+EX int video_buffers = 8;
+
+unique_ptr<frame_ring> ring;
+#endif
+
+#if CAP_VIDEO && CAP_GL
+/** \brief pixel buffer objects for asynchronous glReadPixels in videos: a frame read into one of them is collected while the next one is rendered */
+GLuint pbo[2];
+bool pbo_pending[2];
+int pbo_next, pbo_size;
+
+/** give the frame in pbo[i] to the encoder */
+void pbo_collect(int i) {
+  if(!pbo_pending[i]) return;
+  pbo_pending[i] = false;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+  auto src = (const char*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if(src) {
+    int row = 4 * shotx;
+    #if CAP_THREAD
+    char *dst = ring ? ring->acquire(row * shoty) : nullptr;
+    #else
+    char *dst = nullptr;
+    #endif
+    for(int y=0; y<shoty; y++) {
+      const char *from = src + row * (shoty-1-y);
+      if(dst) memcpy(dst + row * y, from, row);
+      else ignore(write(rawfile_handle, from, row));
+      }
+    #if CAP_THREAD
+    if(dst) ring->publish();
+    #endif
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  GLERR("pbo_collect");
+  }
+
+/** give the frames still in the pixel buffer objects to the encoder, oldest first */
+void pbo_flush() {
+  pbo_collect(pbo_next);
+  pbo_collect(1-pbo_next);
+  }
+
+/** start reading the current frame of rb into a pixel buffer object, and collect the previous frame; false if not possible */
+bool async_readback(renderbuffer& rb) {
+  if(!rb.FramebufferName || rb.x != shotx || rb.y != shoty) return false;
+  int size = 4 * shotx * shoty;
+  if(!pbo[0]) glGenBuffers(2, pbo), pbo_size = 0;
+  if(size != pbo_size) {
+    pbo_flush();
+    for(int i=0; i<2; i++) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+      }
+    pbo_size = size;
+    }
+  int i = pbo_next;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+  glReadPixels(0, 0, shotx, shoty, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  GLERR("async_readback");
+  pbo_pending[i] = true;
+  pbo_next = 1-i;
+  pbo_collect(pbo_next);
+  return true;
+  }
+#endif
+
+#if CAP_VIDEO
+/** \brief called before recording raw frames to rawfile_handle */
+EX void start_video_output() {
+  #if CAP_THREAD
+  ring.reset(new frame_ring(max(video_buffers, 1)));
+  #endif
+  }
+
+/** \brief called after the last frame; all the frames are written when this returns */
+EX void finish_video_output() {
+  #if CAP_GL
+  pbo_flush();
+  if(pbo[0]) glDeleteBuffers(2, pbo), pbo[0] = pbo[1] = 0;
+  #endif
+  #if CAP_THREAD
+  ring = nullptr;
+  #endif
+  }
+#endif
+
 #if CAP_PNG
 
 void output(SDL_Surface* s, const string& fname) {
   if(format == screenshot_format::rawfile) {
+    #if CAP_VIDEO && CAP_GL
+    pbo_flush();
+    #endif
+    #if CAP_VIDEO && CAP_THREAD
+    if(ring) {
+      char *dst = ring->acquire(4 * shotx * shoty);
+      for(int y=0; y<shoty; y++)
+        memcpy(dst + 4 * shotx * y, &qpixel(s, 0, y), 4 * shotx);
+      ring->publish();
+      return;
+      }
+    #endif
     for(int y=0; y<shoty; y++)
       ignore(write(rawfile_handle, &qpixel(s, 0, y), 4 * shotx));
     }
@@ -731,6 +881,11 @@ void render_png(string fname, const function<void()>& what) {
   glbuf.clear(backcolor);
   what();
   
+  #if CAP_VIDEO && CAP_GL
+  if(format == screenshot_format::rawfile && !transparent && gamma == 1 && shot_aa == 1 && async_readback(glbuf))
+    return;
+  #endif
+
   SDL_Surface *sdark = glbuf.render();
 
   if(transparent) {
@@ -1113,6 +1268,8 @@ struct animated_parameter {
   ld last;
   string formula;
   reaction_t reaction;
+  /** formula, compiled on the first use */
+  exp_parser ep;
   };
 
 vector<animated_parameter> aps;
@@ -1131,7 +1288,7 @@ EX void get_parameter_animation(ld &x, string &s) {
 
 EX void animate_parameter(ld &x, string f, const reaction_t& r) {
   deanimate(x);
-  aps.emplace_back(animated_parameter{&x, x, f, r});
+  aps.emplace_back(animated_parameter{&x, x, f, r, exp_parser()});
   }
 
 int ap_changes;
@@ -1141,7 +1298,12 @@ void apply_animated_parameters() {
   for(auto &ap: aps) {
     if(*ap.value != ap.last) continue;
     try {
-      *ap.value = parseld(ap.formula);
+      if(ap.ep.root == -1) {
+        ap.ep = exp_parser();
+        ap.ep.s = ap.formula;
+        ap.ep.compile();
+        }
+      *ap.value = real(ap.ep.eval());
       }
     catch(hr_parse_exception&) {
       continue;
@@ -1393,7 +1555,9 @@ EX bool record_video(string fname IS(videofile), bool_reaction_t rec IS(record_a
   close(tab[0]);
   shot::rawfile_handle = tab[1];
   dynamicval<shot::screenshot_format> sf(shot::format, shot::screenshot_format::rawfile);
+  shot::start_video_output();
   rec();
+  shot::finish_video_output();
   close(tab[1]);
   wait(nullptr);
   callhooks(hooks_after_video);
@@ -1721,6 +1885,11 @@ int readArgs() {
     PHASE(3); shift(); noframes = argi();
     shift(); videofile = args(); record_video();
     }
+  #if CAP_THREAD
+  else if(argis("-animvideo-buffers")) {
+    shift(); shot::video_buffers = argi();
+    }
+  #endif
 #endif
   else if(argis("-animcircle")) {
     PHASE(3); start_game();
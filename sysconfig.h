@@ -185,6 +185,18 @@
 #define MAXMDIM 4
 #endif
 
+#ifndef CAP_SIMD
+#if defined(__SSE2__) && !ISWEB
+#define CAP_SIMD 1
+#else
+#define CAP_SIMD 0
+#endif
+#endif
+
+#ifndef CAP_MMAP
+#define CAP_MMAP (!ISWINDOWS && !ISWEB && !ISMOBILE)
+#endif
+
 #ifndef CAP_MDIM_FIXED
 #define CAP_MDIM_FIXED 0
 #endif
@@ -218,7 +230,7 @@
 #endif
 
 #ifndef CAP_PROFILING
-#define CAP_PROFILING 0
+#define CAP_PROFILING 1
 #endif
 
 #define PSEUDOKEY_WHEELDOWN 2501
@@ -458,12 +470,14 @@ typedef unsigned GLuint;
 #include <string>
 #include <cassert>
 #include <map>
+#include <unordered_map>
 #include <queue>
 #include <sstream>
 #include <stdexcept>
 #include <array>
 #include <set>
 #include <random>
+#include <chrono>
 #include <complex>
 #include <new>
 #include <limits.h>
@@ -484,6 +498,10 @@ typedef unsigned GLuint;
 #include <zlib.h>
 #endif
 
+#if CAP_SIMD
+#include <immintrin.h>
+#endif
+
 #if ISWEB
 #include <emscripten.h>
 #include <emscripten/html5.h>
@@ -503,6 +521,7 @@ typedef unsigned GLuint;
 #include <mutex>
 #include <condition_variable>
 #endif
+#include <atomic>
 #endif
 
 #include <stdint.h>
@@ -527,6 +546,13 @@ typedef unsigned GLuint;
 #include <sys/stat.h>
 #endif
 
+#if CAP_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #if CAP_TIMEOFDAY
 #include <sys/time.h>
 #endif
@@ -76,40 +76,322 @@ EX ld ilerp(ld a0, ld a1, ld x) {
 
 #if CAP_PROFILING
 
-#define FRAMES 64
-#define CATS 16
+#if HDR
+/** \brief a zone recorded by the profiler, in nanoseconds */
+struct profile_event {
+  const char *name;
+  long long start, duration;
+  };
+#endif
+
+/** \brief is the profiler recording (-profile) */
+EX bool profiling = false;
+
+/** \brief the Chrome trace is written here by profile_info (-profile) */
+EX string profile_file;
+
+/** \brief the maximum number of events recorded by every thread; further events are dropped */
+EX int profile_limit = 1<<21;
+
+EX long long profile_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+/** \brief the zones recorded by one thread; kept after the thread ends */
+struct profile_buffer {
+  int tid;
+  int dropped;
+  vector<profile_event> events;
+  /** zones which have been started but not stopped yet */
+  vector<pair<const char*, long long>> open;
+  };
+
+vector<unique_ptr<profile_buffer>> profile_buffers;
+
+#if CAP_THREAD
+std::mutex profile_mutex;
+#endif
+
+thread_local profile_buffer *current_profile_buffer;
+
+profile_buffer& get_profile_buffer() {
+  if(!current_profile_buffer) {
+    #if CAP_THREAD
+    std::lock_guard<std::mutex> lk(profile_mutex);
+    #endif
+    profile_buffers.emplace_back(new profile_buffer);
+    current_profile_buffer = profile_buffers.back().get();
+    current_profile_buffer->tid = isize(profile_buffers) - 1;
+    current_profile_buffer->dropped = 0;
+    }
+  return *current_profile_buffer;
+  }
 
-long long proftable[16][FRAMES];
-int pframeid;
+/** \brief start a zone in the current thread; zones started later are nested in it */
+EX void profile_start(const char *name) {
+  if(!profiling) return;
+  get_profile_buffer().open.emplace_back(name, profile_ns());
+  }
 
-void profile_frame() { 
-  pframeid++; pframeid %=  FRAMES;
-  for(int t=0; t<16; t++) proftable[t][pframeid] = 0;
+/** \brief stop the zone started last in the current thread */
+EX void profile_stop() {
+  if(!current_profile_buffer || current_profile_buffer->open.empty()) return;
+  auto& b = *current_profile_buffer;
+  auto z = b.open.back();
+  b.open.pop_back();
+  if(isize(b.events) >= profile_limit) { b.dropped++; return; }
+  b.events.push_back(profile_event{z.first, z.second, profile_ns() - z.second});
   }
 
-EX void profile_start(int t) { proftable[t][pframeid] -= getms(); }
-EX void profile_stop(int t) { proftable[t][pframeid] += getms(); }
+#if HDR
+/** \brief profile the rest of the scope */
+struct profile_zone {
+  profile_zone(const char *name) { profile_start(name); }
+  ~profile_zone() { profile_stop(); }
+  };
+#endif
+
+/** \brief write the recorded zones of all threads in the Chrome trace format (chrome://tracing, Perfetto) */
+EX void profile_write(const string& fname) {
+  fhstream f(fname, "wt");
+  if(!f.f) { println(hlog, "cannot write ", fname); return; }
+  #if CAP_THREAD
+  std::lock_guard<std::mutex> lk(profile_mutex);
+  #endif
+  long long t0 = 0;
+  bool first = true;
+  for(auto& b: profile_buffers) for(auto& e: b->events) if(first || e.start < t0) t0 = e.start, first = false;
+  println(f, "{\"traceEvents\": [");
+  first = true;
+  for(auto& b: profile_buffers) for(auto& e: b->events) {
+    if(!first) println(f, ",");
+    first = false;
+    print(f, "  {\"name\": \"", e.name, "\", \"ph\": \"X\", \"pid\": 0, \"tid\": ", b->tid, ", \"ts\": ", fts((e.start - t0) / 1000., 15), ", \"dur\": ", fts(e.duration / 1000., 15), "}");
+    }
+  println(f, "\n]}");
+  }
 
-void profile_info() {
-  for(int t=0; t<16; t++) {
-    sort(proftable[t], proftable[t]+FRAMES);
-    if(proftable[t][FRAMES-1] == 0) continue;
-    long long sum = 0;
-    for(int f=0; f<FRAMES; f++) sum += proftable[t][f];
-    printf("Category %d: avg = %Ld, %Ld..%Ld..%Ld..%Ld..%Ld\n",
-      t, sum / FRAMES, proftable[t][0], proftable[t][16], proftable[t][32],
-      proftable[t][48], proftable[t][63]);
+/** \brief print the total time of every zone, and write the Chrome trace if requested */
+EX void profile_info() {
+  if(profile_buffers.empty()) return;
+  struct zone_stats { int count; long long total, longest; };
+  map<string, zone_stats> stats;
+  int dropped = 0;
+  for(auto& b: profile_buffers) {
+    dropped += b->dropped;
+    for(auto& e: b->events) {
+      auto& s = stats[e.name];
+      s.count++; s.total += e.duration; s.longest = max(s.longest, e.duration);
+      }
     }
+  for(auto& p: stats)
+    println(hlog, p.first, ": ", p.second.count, " calls, total ", fts(p.second.total / 1e6), " ms, average ", fts(p.second.total / 1e3 / p.second.count), " us, longest ", fts(p.second.longest / 1e3), " us");
+  if(dropped) println(hlog, "profiler: ", dropped, " events dropped (see profile_limit)");
+  if(profile_file != "") profile_write(profile_file);
   }
+
+#if CAP_COMMANDLINE
+auto profile_hook = 
+  addHook(hooks_args, 100, [] () {
+    using namespace arg;
+    if(argis("-profile")) { shift(); profile_file = args(); profiling = true; return 0; }
+    else if(argis("-profile-limit")) { shift(); profile_limit = argi(); return 0; }
+    else return 1;
+    });
+#endif
 #endif
 
 #if !CAP_PROFILING
 #if HDR
-#define profile_frame()
-#define profile_start(t)
-#define profile_stop(t)
+#define profile_start(name)
+#define profile_stop()
 #define profile_info()
+struct profile_zone { profile_zone(const char *name) {} };
+#endif
+#endif
+
+#if HDR
+/** \brief the phases of a turn measured by turn_timer */
+enum eTurnPhase { tpBFS, tpMonsters, tpSetdist, tpSaveMemory, tpCount };
+#endif
+
+/** \brief should turn_timer measure anything (used by the autoplay benchmark in devmods) */
+EX bool turn_timers_on = false;
+
+/** \brief the total time in seconds spent in each eTurnPhase */
+EX double turn_phase_time[tpCount];
+
+/** \brief the number of turn_timer objects currently alive for each eTurnPhase (the outermost one measures the time) */
+EX int turn_phase_depth[tpCount];
+
+/** \brief the names of the eTurnPhases in the profiler */
+EX const char *turn_phase_names[tpCount] = {"bfs", "monstersTurn", "setdist", "saveMemory"};
+
+#if HDR
+/** \brief add the time until the end of the scope to turn_phase_time[p], and profile it as a zone
+ *
+ *  Nested and recursive calls are counted once: only the outermost turn_timer for p measures the time
+ *  and opens the zone, so the profiler totals are not counted twice.
+ */
+struct turn_timer {
+  eTurnPhase p;
+  bool active;
+  std::chrono::steady_clock::time_point start;
+  turn_timer(eTurnPhase p) : p(p), active(turn_timers_on) {
+    if(turn_phase_depth[p]++) return;
+    profile_start(turn_phase_names[p]);
+    if(active) start = std::chrono::steady_clock::now();
+    }
+  ~turn_timer() {
+    if(--turn_phase_depth[p]) return;
+    if(active)
+      turn_phase_time[p] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    profile_stop();
+    }
+  };
 #endif
+
+#if HDR
+inline size_t epoch_hash(uint64_t x) {
+  uint64_t h = x * 0x9E3779B97F4A7C15ull;
+  return size_t(h ^ (h >> 32));
+  }
+
+inline size_t epoch_hash(unsigned x) { return epoch_hash(uint64_t(x)); }
+
+template<class T> size_t epoch_hash(T *p) { return epoch_hash(uint64_t(size_t(p) >> 3)); }
+
+/** \brief an open addressing hash set, for sets which are cleared very often
+ *
+ *  A slot is used iff it has the current epoch, so clear() just increases the epoch.
+ */
+template<class K> struct epoch_set {
+  struct slot { K key; unsigned epoch; };
+  vector<slot> slots;
+  unsigned epoch = 1;
+  int qty = 0;
+
+  bool count(K k) const {
+    if(slots.empty()) return false;
+    size_t mask = slots.size() - 1;
+    for(size_t i = epoch_hash(k) & mask;; i = (i+1) & mask) {
+      if(slots[i].epoch != epoch) return false;
+      if(slots[i].key == k) return true;
+      }
+    }
+
+  void insert(K k) {
+    if(2 * (qty+1) > isize(slots)) grow();
+    size_t mask = slots.size() - 1;
+    for(size_t i = epoch_hash(k) & mask;; i = (i+1) & mask) {
+      if(slots[i].epoch != epoch) { slots[i].key = k; slots[i].epoch = epoch; qty++; return; }
+      if(slots[i].key == k) return;
+      }
+    }
+
+  void grow() {
+    vector<slot> old(max<size_t>(64, 2 * slots.size()), slot{K(), 0});
+    swap(old, slots);
+    qty = 0;
+    for(auto& s: old) if(s.epoch == epoch) insert(s.key);
+    }
+
+  int size() const { return qty; }
+
+  void clear() {
+    qty = 0;
+    if(!++epoch) { epoch = 1; for(auto& s: slots) s.epoch = 0; }
+    }
+  };
+
+/** \brief a replacement for map<K, V> for maps which are cleared very often (such as gmatrix)
+ *
+ *  The index is an epoch_set-like hash table; the entries are kept in chunks which are reused
+ *  after clear(), so references stay valid until then. Iteration goes in the order of insertion.
+ */
+template<class K, class V> struct epoch_map {
+  typedef pair<K, V> value_type;
+  static const int chunk_size = 256;
+  struct slot { K key; unsigned epoch; int id; };
+  vector<slot> slots;
+  unsigned epoch = 1;
+  int used = 0;
+  vector<unique_ptr<value_type[]>> chunks;
+
+  epoch_map() {}
+  epoch_map(const epoch_map& m) { *this = m; }
+  epoch_map(epoch_map&&) = default;
+  epoch_map& operator = (epoch_map&&) = default;
+  epoch_map& operator = (const epoch_map& m) {
+    if(this != &m) { clear(); for(auto& p: m) (*this)[p.first] = p.second; }
+    return *this;
+    }
+
+  value_type& entry(int id) { return chunks[id / chunk_size][id % chunk_size]; }
+  const value_type& entry(int id) const { return chunks[id / chunk_size][id % chunk_size]; }
+
+  int find_id(K k) const {
+    if(slots.empty()) return -1;
+    size_t mask = slots.size() - 1;
+    for(size_t i = epoch_hash(k) & mask;; i = (i+1) & mask) {
+      if(slots[i].epoch != epoch) return -1;
+      if(slots[i].key == k) return slots[i].id;
+      }
+    }
+
+  void index(K k, int id) {
+    size_t mask = slots.size() - 1;
+    size_t i = epoch_hash(k) & mask;
+    while(slots[i].epoch == epoch) i = (i+1) & mask;
+    slots[i] = slot{k, epoch, id};
+    }
+
+  V& operator [] (K k) {
+    int id = find_id(k);
+    if(id >= 0) return entry(id).second;
+    if(2 * (used+1) > isize(slots)) {
+      slots.assign(max<size_t>(64, 2 * slots.size()), slot{K(), 0, 0});
+      for(int i=0; i<used; i++) index(entry(i).first, i);
+      }
+    index(k, used);
+    if(used == isize(chunks) * chunk_size) chunks.emplace_back(new value_type[chunk_size]);
+    auto& e = entry(used++);
+    e.first = k; e.second = V();
+    return e.second;
+    }
+
+  int count(K k) const { return find_id(k) >= 0; }
+
+  V& at(K k) {
+    int id = find_id(k);
+    if(id < 0) throw std::out_of_range("epoch_map::at");
+    return entry(id).second;
+    }
+
+  int size() const { return used; }
+  bool empty() const { return !used; }
+
+  void clear() {
+    used = 0;
+    if(!++epoch) { epoch = 1; for(auto& s: slots) s.epoch = 0; }
+    }
+
+  template<class M, class T> struct iter {
+    M *m; int id;
+    T& operator * () const { return m->entry(id); }
+    T* operator -> () const { return &m->entry(id); }
+    iter& operator ++ () { id++; return *this; }
+    iter operator ++ (int) { iter i = *this; id++; return i; }
+    bool operator == (const iter& i) const { return id == i.id; }
+    bool operator != (const iter& i) const { return id != i.id; }
+    };
+  typedef iter<epoch_map, value_type> iterator;
+  typedef iter<const epoch_map, const value_type> const_iterator;
+  iterator begin() { return iterator{this, 0}; }
+  iterator end() { return iterator{this, used}; }
+  const_iterator begin() const { return const_iterator{this, 0}; }
+  const_iterator end() const { return const_iterator{this, used}; }
+  };
 #endif
 
 EX purehookset hooks_tests;
@@ -131,16 +413,45 @@ struct hr_parse_exception : hr_exception {
   ~hr_parse_exception() noexcept(true) {}
   };
 
+/** operations in compiled formulas, see exp_node */
+enum class eop : char {
+  constant, param, extra, neg, add, sub, mul, div, power, 
+  sin, cos, sinh, cosh, asin, acos, asinh, acosh, exp, sqrt, log, tan, tanh, atan, atanh, abs, re, im, conj, floor, frac, to01,
+  edge, edge_angles, regradius, arcmedge, regangle, test, ifp, wallif, rgb, let, txp, spline,
+  seconds, ms, mousex, mousey, mousez, random, shot, ultra_mirror_dist, psl_steps, single_step, step, edgelen
+  };
+
+/** \brief a node of a formula compiled by exp_parser
+ *
+ *  Names are resolved while compiling: params are bound by pointer, and only extra_params are looked up on evaluation,
+ *  since their values may be changed between evaluations.
+ */
+struct exp_node {
+  eop op;
+  cld val;
+  ld *param;
+  string name;
+  /** subexpressions, as indices to exp_parser::nodes; -1 for a missing derivative in a spline */
+  vector<int> args;
+  /** the position after this node, for error messages */
+  int at, line_number, last_line;
+  };
+
 struct exp_parser {
   string s;
   int at;
   int line_number, last_line;
-  exp_parser() { at = 0; line_number = 1; last_line = 0; }
+  exp_parser() { at = 0; line_number = 1; last_line = 0; root = -1; }
   
   string where() { 
     if(s.find('\n')) return "(line " + its(line_number) + ", pos " + its(at-last_line) + ")";
     else return "(pos " + its(at) + ")";
     }
+
+  string where(const exp_node& n) { 
+    if(s.find('\n')) return "(line " + its(n.line_number) + ", pos " + its(n.at-n.last_line) + ")";
+    else return "(pos " + its(n.at) + ")";
+    }
   
   map<string, cld> extra_params;
 
@@ -161,7 +472,32 @@ struct exp_parser {
 
   char snext(int step=0) { skip_white(); return next(step); }
 
-  cld parse(int prio = 0);
+  /** the compiled formulas */
+  vector<exp_node> nodes;
+  /** the formula compiled by compile() */
+  int root;
+
+  int add_node(eop op, vector<int> args = {}, cld val = 0);
+  int compile_node(int prio = 0);
+  int compile_par() {
+    int res = compile_node();
+    force_eat(")");
+    return res;
+    }
+
+  cld eval(int id);
+  ld reval(int id) { return validate_real(eval(id), nodes[id]); }
+
+  /** \brief compile s (from the current position), so that it can be evaluated many times with eval() */
+  void compile() { nodes.clear(); root = compile_node(); }
+  cld eval() { return eval(root); }
+
+  cld parse(int prio = 0) {
+    int first = isize(nodes);
+    cld res = eval(compile_node(prio));
+    nodes.resize(first);
+    return res;
+    }
 
   ld rparse(int prio = 0) { return validate_real(parse(prio)); }
   int iparse(int prio = 0) { return int(floor(rparse(prio) + .5)); }
@@ -177,6 +513,11 @@ struct exp_parser {
     return real(x);
     }
   
+  ld validate_real(cld x, const exp_node& n) {
+    if(kz(imag(x))) throw hr_parse_exception("expected real number but " + lalign(-1, x) + " found at " + where(n));
+    return real(x);
+    }
+  
   void force_eat(const char *c) {
     skip_white();
     if(!eat(c)) throw hr_parse_exception("expected: " + string(c) + " at " + where());
@@ -207,238 +548,298 @@ string exp_parser::next_token() {
   return token;
   }
 
-cld exp_parser::parse(int prio) {
-  cld res;
-  skip_white();
-  if(eat("sin(")) res = sin(parsepar());
-  else if(eat("cos(")) res = cos(parsepar());
-  else if(eat("sinh(")) res = sinh(parsepar());
-  else if(eat("cosh(")) res = cosh(parsepar());
-  else if(eat("asin(")) res = asin(parsepar());
-  else if(eat("acos(")) res = acos(parsepar());
-  else if(eat("asinh(")) res = asinh(parsepar());
-  else if(eat("acosh(")) res = acosh(parsepar());
-  else if(eat("exp(")) res = exp(parsepar());
-  else if(eat("sqrt(")) res = sqrt(parsepar());
-  else if(eat("log(")) res = log(parsepar());
-  else if(eat("tan(")) res = tan(parsepar());
-  else if(eat("tanh(")) res = tanh(parsepar());
-  else if(eat("atan(")) res = atan(parsepar());
-  else if(eat("atanh(")) res = atanh(parsepar());
-  else if(eat("abs(")) res = abs(parsepar());
-  else if(eat("re(")) res = real(parsepar());
-  else if(eat("im(")) res = imag(parsepar());
-  else if(eat("conj(")) res = std::conj(parsepar());
-  else if(eat("floor(")) res = floor(validate_real(parsepar()));
-  else if(eat("frac(")) { res = parsepar(); res = res - floor(validate_real(res)); }
-  else if(eat("to01(")) { res = parsepar(); return atan(res) / ld(M_PI) + ld(0.5); }
-  else if(eat("edge(")) {
-    ld a = rparse(0);
-    force_eat(",");
-    ld b = rparse(0);
-    force_eat(")");
-    res = edge_of_triangle_with_angles(2*M_PI/a, M_PI/b, M_PI/b);
-    }
-  else if(eat("edge_angles(")) {
-    cld a = rparse(0);
-    force_eat(",");
-    cld b = rparse(0);
-    force_eat(",");
-    cld c = rparse(0);
-    force_eat(")");
+int exp_parser::add_node(eop op, vector<int> args, cld val) {
+  exp_node n;
+  n.op = op; n.val = val; n.param = nullptr; n.args = std::move(args);
+  n.at = at; n.line_number = line_number; n.last_line = last_line;
+  nodes.push_back(std::move(n));
+  return isize(nodes) - 1;
+  }
 
-    if(extra_params.count("angleunit")) {    
-      
-      a *= extra_params["angleunit"];
-      b *= extra_params["angleunit"];
-      c *= extra_params["angleunit"];
+int exp_parser::compile_node(int prio) {
+  int res;
+  skip_white();
+  static const vector<pair<const char*, eop>> unary = {
+    {"sin(", eop::sin}, {"cos(", eop::cos}, {"sinh(", eop::sinh}, {"cosh(", eop::cosh}, 
+    {"asin(", eop::asin}, {"acos(", eop::acos}, {"asinh(", eop::asinh}, {"acosh(", eop::acosh}, 
+    {"exp(", eop::exp}, {"sqrt(", eop::sqrt}, {"log(", eop::log}, {"tan(", eop::tan}, {"tanh(", eop::tanh}, 
+    {"atan(", eop::atan}, {"atanh(", eop::atanh}, {"abs(", eop::abs}, {"re(", eop::re}, {"im(", eop::im}, 
+    {"conj(", eop::conj}, {"floor(", eop::floor}, {"frac(", eop::frac}, {"test(", eop::test}
+    #if CAP_TEXTURE
+    , {"txp(", eop::txp}
+    #endif
+    };
+  auto args = [this] (int qty) {
+    vector<int> res;
+    for(int i=0; i<qty; i++) {
+      if(i) force_eat(",");
+      res.push_back(compile_node(0));
       }
-
-    return edge_of_triangle_with_angles(real(a), real(b), real(c));
-    }
-  else if(eat("regradius(")) {
-    ld a = rparse(0);
-    force_eat(",");
-    ld b = rparse(0);
     force_eat(")");
-    res = edge_of_triangle_with_angles(M_PI/2, M_PI/a, M_PI/b);
-    }
+    return res;
+    };
+  for(auto& u: unary) if(eat(u.first)) { int arg = compile_par(); res = add_node(u.second, {arg}); goto operators; }
+  if(eat("to01(")) { int arg = compile_par(); return add_node(eop::to01, {arg}); }
+  else if(eat("edge(")) res = add_node(eop::edge, args(2));
+  else if(eat("edge_angles(")) return add_node(eop::edge_angles, args(3));
+  else if(eat("regradius(")) res = add_node(eop::regradius, args(2));
   #if CAP_ARCM
   else if(eat("arcmedge(")) {
     vector<int> vals;
-    vals.push_back(iparse(0));
+    vals.push_back(compile_node(0));
     while(true) {
       skip_white();
-      if(eat(",")) vals.push_back(iparse(0));
+      if(eat(",")) vals.push_back(compile_node(0));
       else break;
       }
     force_eat(")");
-    arcm::archimedean_tiling test;
-    test.faces = vals;
-    test.compute_sum();
-    test.compute_geometry();
-    res = test.edgelength;
-    if(extra_params.count("distunit"))
-      res /= extra_params["distunit"];
+    res = add_node(eop::arcmedge, vals);
     }
   #endif
-  else if(eat("regangle(")) {
-    cld edgelen = parse(0);
-    if(extra_params.count("distunit")) {
-      edgelen = edgelen * extra_params["distunit"];
-      }
-    
-    force_eat(",");
-    ld edges = rparse(0);
-    force_eat(")");
-    ld alpha = M_PI / edges;
-    ld c = asin_auto(sin_auto(validate_real(edgelen)/2) / sin(alpha));
-    hyperpoint h = xpush(c) * spin(M_PI - 2*alpha) * xpush0(c);
-    ld result = 2 * atan2(h);
-    if(result < 0) result = -result;
-    while(result > 2 * M_PI) result -= 2 * M_PI;
-    if(result > M_PI) result = 2 * M_PI - result;
-    
-    if(arb::legacy) {
-      res = M_PI - result;
-      if(extra_params.count("angleofs"))
-        res -= extra_params["angleofs"];
-      }
-    else
-      res = result;
-
-    if(extra_params.count("angleunit"))
-      res /= extra_params["angleunit"];    
-    }
-  else if(eat("test(")) {
-    res = parsepar();
-    println(hlog, "res = ", res, ": ", fts(real(res), 10), ",", fts(imag(res), 10));
-    }
-  else if(eat("ifp(")) {
-    cld cond = parse(0);
-    force_eat(",");
-    cld yes = parse(0);
-    force_eat(",");
-    cld no = parsepar();
-    res = real(cond) > 0 ? yes : no;
-    }  
-  else if(eat("wallif(")) {
-    cld val0 = parse(0);
-    force_eat(",");
-    cld val1 = parsepar();
-    if(real(extra_params["p"]) >= 3.5) res = val0;
-    else res = val1;
-    }
-  else if(eat("rgb(")) {     
-    cld val0 = parse(0);
-    force_eat(",");
-    cld val1 = parse(0);
-    force_eat(",");
-    cld val2 = parsepar();
-    switch(int(real(extra_params["p"]) + .5)) {
-      case 1: res = val0; break;
-      case 2: res = val1; break;
-      case 3: res = val2; break;
-      default: res = 0;
-      }
-    }
+  else if(eat("regangle(")) res = add_node(eop::regangle, args(2));
+  else if(eat("ifp(")) res = add_node(eop::ifp, args(3));
+  else if(eat("wallif(")) res = add_node(eop::wallif, args(2));
+  else if(eat("rgb(")) res = add_node(eop::rgb, args(3));
   else if(eat("let(")) {
     string name = next_token();
     force_eat("=");
-    cld val = parse(0);
+    int val = compile_node(0);
     force_eat(",");
-    dynamicval<cld> d(extra_params[name], val);
-    res = parsepar();
+    dynamicval<cld> d(extra_params[name], 0);
+    int body = compile_par();
+    res = add_node(eop::let, {val, body});
+    nodes[res].name = name;
     }
-  #if CAP_TEXTURE
-  else if(eat("txp(")) {
-    cld val = parsepar();
-    res = texture::get_txp(real(val), imag(val), int(real(extra_params["p"]) + .5)-1);
-    }
-  #endif
-  else if(next() == '(') at++, res = parsepar(); 
+  else if(next() == '(') at++, res = compile_par(); 
   else {
     string number = next_token();
-    if(extra_params.count(number)) res = extra_params[number];
-    else if(params.count(number)) res = params.at(number);
-    else if(number == "e") res = exp(1);
-    else if(number == "i") res = cld(0, 1);
-    else if(number == "p" || number == "pi") res = M_PI;
-    else if(number == "" && next() == '-') { at++; res = -parse(prio); }
+    static const vector<pair<const char*, eop>> variables = {
+      {"s", eop::seconds}, {"ms", eop::ms}, {"mousex", eop::mousex}, {"mousey", eop::mousey}, {"mousez", eop::mousez},
+      {"random", eop::random}, {"shot", eop::shot}, {"ultra_mirror_dist", eop::ultra_mirror_dist}, 
+      {"psl_steps", eop::psl_steps}, {"single_step", eop::single_step}, {"step", eop::step}, {"edgelen", eop::edgelen}
+      };
+    auto constant = [this] (cld val) { return add_node(eop::constant, {}, val); };
+    if(extra_params.count(number)) { res = add_node(eop::extra); nodes[res].name = number; }
+    else if(params.count(number)) { res = add_node(eop::param); nodes[res].param = &params.at(number); }
+    else if(number == "e") res = constant(exp(1));
+    else if(number == "i") res = constant(cld(0, 1));
+    else if(number == "p" || number == "pi") res = constant(M_PI);
+    else if(number == "" && next() == '-') { at++; int arg = compile_node(prio); res = add_node(eop::neg, {arg}); }
     else if(number == "") throw hr_parse_exception("number missing, " + where());
-    else if(number == "s") res = ticks / 1000.;
-    else if(number == "ms") res = ticks;
-    else if(number[0] == '0' && number[1] == 'x') res = strtoll(number.c_str()+2, NULL, 16);
-    else if(number == "mousex") res = mousex;
-    else if(number == "deg") res = degree;
-    else if(number == "ultra_mirror_dist") res = cgi.ultra_mirror_dist;
-    else if(number == "psl_steps") res = cgi.psl_steps;
-    else if(number == "single_step") res = cgi.single_step;
-    else if(number == "step") res = hdist0(tC0(currentmap->adj(cwt.at, 0)));
-    else if(number == "edgelen") res = hdist(get_corner_position(cwt.at, 0), get_corner_position(cwt.at, 1));
-    else if(number == "mousey") res = mousey;
-    else if(number == "random") res = randd();
-    else if(number == "mousez") res = cld(mousex - current_display->xcenter, mousey - current_display->ycenter) / cld(current_display->radius, 0);
-    else if(number == "shot") res = inHighQual ? 1 : 0;
-    else if(number[0] >= 'a' && number[0] <= 'z') throw hr_parse_exception("unknown value: " + number);
-    else { std::stringstream ss; res = 0; ss << number; ss >> res; }
+    else if(number[0] == '0' && number[1] == 'x') res = constant(strtoll(number.c_str()+2, NULL, 16));
+    else if(number == "deg") res = constant(degree);
+    else {
+      res = -1;
+      for(auto& v: variables) if(number == v.first) res = add_node(v.second);
+      if(res != -1) ;
+      else if(number[0] >= 'a' && number[0] <= 'z') throw hr_parse_exception("unknown value: " + number);
+      else { std::stringstream ss; cld val = 0; ss << number; ss >> val; res = constant(val); }
+      }
     }
+  operators:
   while(true) {
     skip_white();
     #if CAP_ANIMATIONS
     if(next() == '.' && next(1) == '.' && prio == 0) {
-      static const cld NO_DERIVATIVE(3.1, 2.5);
-      vector<array<cld, 4>> rest = { make_array(res, NO_DERIVATIVE, res, NO_DERIVATIVE) };
+      /* the spline is stored as a sequence of (value, derivative, value, derivative) quadruples; -1 is no derivative */
+      vector<int> rest = {res, -1, res, -1};
       bool second = true;
       while(next() == '.' && next(1) == '.') {
+        int last = isize(rest) - 4;
         /* spline interpolation */
         if(next(2) == '/') {
           at += 3;
-          rest.back()[second ? 3 : 1] = parse(10);
+          rest[last + (second ? 3 : 1)] = compile_node(10);
           continue;
           }
         /* sharp end */
         else if(next(2) == '|') {
           at += 3;
-          rest.back()[2] = parse(10);
-          rest.back()[3] = NO_DERIVATIVE;
+          rest[last + 2] = compile_node(10);
+          rest[last + 3] = -1;
           second = true;
           continue;
           }
         at += 2; 
-        auto val = parse(10);
-        rest.emplace_back(make_array(val, NO_DERIVATIVE, val, NO_DERIVATIVE));
+        int val = compile_node(10);
+        for(int v: {val, -1, val, -1}) rest.push_back(v);
         second = false;
         }
-      ld v = ticks * (isize(rest)-1.) / anims::period;
-      int vf = v;
-      v -= vf;
-      vf %= (isize(rest)-1);
-      auto& lft = rest[vf];
-      auto& rgt = rest[vf+1];
-      if(lft[3] == NO_DERIVATIVE && rgt[1] == NO_DERIVATIVE)
-        res = lerp(lft[2], rgt[0], v);
-      else if(rgt[1] == NO_DERIVATIVE)
-        res = lerp(lft[2] + lft[3] * v, rgt[0], v*v);
-      else if(lft[3] == NO_DERIVATIVE)
-        res = lerp(lft[2], rgt[0] + rgt[1] * (v-1), (2-v)*v);
-      else {
-        res = lerp(lft[2] + lft[3] * v, rgt[0] + rgt[1] * (v-1), v*v*(3-2*v));
-        }
-      return res;
+      return add_node(eop::spline, rest);
       }
     else 
     #endif
-    if(next() == '+' && prio <= 10) at++, res = res + parse(20);
-    else if(next() == '-' && prio <= 10) at++, res = res - parse(20);
-    else if(next() == '*' && prio <= 20) at++, res = res * parse(30);
-    else if(next() == '/' && prio <= 20) at++, res = res / parse(30);
-    else if(next() == '^') at++, res = pow(res, parse(40));
+    if(next() == '+' && prio <= 10) { at++; int arg = compile_node(20); res = add_node(eop::add, {res, arg}); }
+    else if(next() == '-' && prio <= 10) { at++; int arg = compile_node(20); res = add_node(eop::sub, {res, arg}); }
+    else if(next() == '*' && prio <= 20) { at++; int arg = compile_node(30); res = add_node(eop::mul, {res, arg}); }
+    else if(next() == '/' && prio <= 20) { at++; int arg = compile_node(30); res = add_node(eop::div, {res, arg}); }
+    else if(next() == '^') { at++; int arg = compile_node(40); res = add_node(eop::power, {res, arg}); }
     else break;
     }
   return res;
   }
 
+cld exp_parser::eval(int id) {
+  auto& n = nodes[id];
+  auto& a = n.args;
+  auto arg = [&] (int i) { return eval(a[i]); };
+  switch(n.op) {
+    case eop::constant: return n.val;
+    case eop::param: return *n.param;
+    case eop::extra: return extra_params[n.name];
+    case eop::neg: return -arg(0);
+    case eop::add: return arg(0) + arg(1);
+    case eop::sub: return arg(0) - arg(1);
+    case eop::mul: return arg(0) * arg(1);
+    case eop::div: return arg(0) / arg(1);
+    case eop::power: return pow(arg(0), arg(1));
+    case eop::sin: return sin(arg(0));
+    case eop::cos: return cos(arg(0));
+    case eop::sinh: return sinh(arg(0));
+    case eop::cosh: return cosh(arg(0));
+    case eop::asin: return asin(arg(0));
+    case eop::acos: return acos(arg(0));
+    case eop::asinh: return asinh(arg(0));
+    case eop::acosh: return acosh(arg(0));
+    case eop::exp: return exp(arg(0));
+    case eop::sqrt: return sqrt(arg(0));
+    case eop::log: return log(arg(0));
+    case eop::tan: return tan(arg(0));
+    case eop::tanh: return tanh(arg(0));
+    case eop::atan: return atan(arg(0));
+    case eop::atanh: return atanh(arg(0));
+    case eop::abs: return abs(arg(0));
+    case eop::re: return real(arg(0));
+    case eop::im: return imag(arg(0));
+    case eop::conj: return std::conj(arg(0));
+    case eop::floor: return floor(reval(a[0]));
+    case eop::frac: { cld res = arg(0); return res - floor(validate_real(res, nodes[a[0]])); }
+    case eop::to01: return atan(arg(0)) / ld(M_PI) + ld(0.5);
+    case eop::edge: { 
+      ld x = reval(a[0]), y = reval(a[1]);
+      return edge_of_triangle_with_angles(2*M_PI/x, M_PI/y, M_PI/y);
+      }
+    case eop::edge_angles: {
+      cld x = reval(a[0]), y = reval(a[1]), z = reval(a[2]);
+      if(extra_params.count("angleunit")) {
+        x *= extra_params["angleunit"];
+        y *= extra_params["angleunit"];
+        z *= extra_params["angleunit"];
+        }
+      return edge_of_triangle_with_angles(real(x), real(y), real(z));
+      }
+    case eop::regradius: {
+      ld x = reval(a[0]), y = reval(a[1]);
+      return edge_of_triangle_with_angles(M_PI/2, M_PI/x, M_PI/y);
+      }
+    #if CAP_ARCM
+    case eop::arcmedge: {
+      arcm::archimedean_tiling test;
+      for(int v: a) test.faces.push_back(int(floor(reval(v) + .5)));
+      test.compute_sum();
+      test.compute_geometry();
+      cld res = test.edgelength;
+      if(extra_params.count("distunit"))
+        res /= extra_params["distunit"];
+      return res;
+      }
+    #endif
+    case eop::regangle: {
+      cld edgelen = arg(0);
+      if(extra_params.count("distunit")) {
+        edgelen = edgelen * extra_params["distunit"];
+        }
+      ld edges = reval(a[1]);
+      ld alpha = M_PI / edges;
+      ld c = asin_auto(sin_auto(validate_real(edgelen, nodes[a[0]])/2) / sin(alpha));
+      hyperpoint h = xpush(c) * spin(M_PI - 2*alpha) * xpush0(c);
+      ld result = 2 * atan2(h);
+      if(result < 0) result = -result;
+      while(result > 2 * M_PI) result -= 2 * M_PI;
+      if(result > M_PI) result = 2 * M_PI - result;
+      
+      cld res;
+      if(arb::legacy) {
+        res = M_PI - result;
+        if(extra_params.count("angleofs"))
+          res -= extra_params["angleofs"];
+        }
+      else
+        res = result;
+  
+      if(extra_params.count("angleunit"))
+        res /= extra_params["angleunit"];    
+      return res;
+      }
+    case eop::test: {
+      cld res = arg(0);
+      println(hlog, "res = ", res, ": ", fts(real(res), 10), ",", fts(imag(res), 10));
+      return res;
+      }
+    case eop::ifp: {
+      cld cond = arg(0), yes = arg(1), no = arg(2);
+      return real(cond) > 0 ? yes : no;
+      }
+    case eop::wallif: {
+      cld val0 = arg(0), val1 = arg(1);
+      return real(extra_params["p"]) >= 3.5 ? val0 : val1;
+      }
+    case eop::rgb: {
+      cld val0 = arg(0), val1 = arg(1), val2 = arg(2);
+      switch(int(real(extra_params["p"]) + .5)) {
+        case 1: return val0;
+        case 2: return val1;
+        case 3: return val2;
+        default: return 0;
+        }
+      }
+    case eop::let: {
+      cld val = arg(0);
+      dynamicval<cld> d(extra_params[n.name], val);
+      return arg(1);
+      }
+    #if CAP_TEXTURE
+    case eop::txp: {
+      cld val = arg(0);
+      return texture::get_txp(real(val), imag(val), int(real(extra_params["p"]) + .5)-1);
+      }
+    #endif
+    #if CAP_ANIMATIONS
+    case eop::spline: {
+      static const cld NO_DERIVATIVE(3.1, 2.5);
+      int q = isize(a) / 4;
+      ld v = ticks * (q-1.) / anims::period;
+      int vf = v;
+      v -= vf;
+      vf %= (q-1);
+      auto get = [&] (int i) { return a[i] == -1 ? NO_DERIVATIVE : eval(a[i]); };
+      cld l2 = get(4*vf+2), l3 = get(4*vf+3), r0 = get(4*vf+4), r1 = get(4*vf+5);
+      if(l3 == NO_DERIVATIVE && r1 == NO_DERIVATIVE)
+        return lerp(l2, r0, v);
+      else if(r1 == NO_DERIVATIVE)
+        return lerp(l2 + l3 * v, r0, v*v);
+      else if(l3 == NO_DERIVATIVE)
+        return lerp(l2, r0 + r1 * (v-1), (2-v)*v);
+      else
+        return lerp(l2 + l3 * v, r0 + r1 * (v-1), v*v*(3-2*v));
+      }
+    #endif
+    case eop::seconds: return ticks / 1000.;
+    case eop::ms: return ticks;
+    case eop::mousex: return mousex;
+    case eop::mousey: return mousey;
+    case eop::mousez: return cld(mousex - current_display->xcenter, mousey - current_display->ycenter) / cld(current_display->radius, 0);
+    case eop::random: return randd();
+    case eop::shot: return inHighQual ? 1 : 0;
+    case eop::ultra_mirror_dist: return cgi.ultra_mirror_dist;
+    case eop::psl_steps: return cgi.psl_steps;
+    case eop::single_step: return cgi.single_step;
+    case eop::step: return hdist0(tC0(currentmap->adj(cwt.at, 0)));
+    case eop::edgelen: return hdist(get_corner_position(cwt.at, 0), get_corner_position(cwt.at, 1));
+    default: throw hr_parse_exception("operation not available in this build");
+    }
+  }
+
 EX ld parseld(const string& s) {
   exp_parser ep;
   ep.s = s;
@@ -721,4 +1122,64 @@ EX string decompress_string(string s) {
   }
 #endif
 
+#if HDR
+/** \brief read-only contents of a whole file
+ *
+ *  Mapped into memory if CAP_MMAP, so that the pages are only read when used, and shared with
+ *  other processes using the same file. Otherwise the file is read into the buffer.
+ */
+struct mapped_file {
+  const char *data = nullptr;
+  size_t size = 0;
+  void *mapping = nullptr;
+  vector<char> buffer;
+  ~mapped_file();
+  };
+#endif
+
+mapped_file::~mapped_file() {
+  #if CAP_MMAP
+  if(mapping) munmap(mapping, size);
+  #endif
+  }
+
+/** \brief open the given file as a mapped_file, or return nullptr if it cannot be read
+ *
+ *  Files which are still in use are not opened again.
+ */
+EX shared_ptr<mapped_file> map_file(const string& fname) {
+  static map<string, weak_ptr<mapped_file>> opened;
+  auto& w = opened[fname];
+  if(auto p = w.lock()) return p;
+  auto res = make_shared<mapped_file>();
+  #if CAP_MMAP
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if(fd < 0) return nullptr;
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(m != MAP_FAILED) {
+      res->mapping = m;
+      res->data = (const char*) m;
+      res->size = st.st_size;
+      }
+    }
+  ::close(fd);
+  #endif
+  if(!res->data) {
+    FILE *f = fopen(fname.c_str(), "rb");
+    if(!f) return nullptr;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    res->buffer.resize(len);
+    if(len > 0) ignore(fread(&res->buffer[0], len, 1, f));
+    fclose(f);
+    res->data = res->buffer.data();
+    res->size = len;
+    }
+  w = res;
+  return res;
+  }
+
 }